@@ -1,18 +1,36 @@
 #pragma once
 #include "config.h"
+#include "i2c_bus.h"
+#include "job.h"
 #include <Arduino.h>
-#include <Wire.h>
 
 class I2CMaster {
 public:
+    enum I2C_PROTOCOL : uint8_t {
+        I2C_PROTO_NATIVE,       // this project's command protocol
+        I2C_PROTO_LEGACY        // stock Duino-Coin text protocol, see wirewrap.h
+    };
+
     struct I2C_SLAVE {
         uint8_t address;
         char slaveUniqueID [(8*2)+1];
         bool isMining;
+        I2C_PROTOCOL protocol;
+    };
+
+    struct I2C_BUS_STATS {
+        uint32_t recoveries = 0;          // number of bus recoveries performed
+        uint32_t failedRecoveries = 0;    // recoveries after which SDA was still held low
+        uint32_t lastRecoveryMs = 0;      // millis() when the last recovery ran
+        uint32_t lastRecoveryUs = 0;      // duration of the last recovery
+        uint32_t totalRecoveryUs = 0;     // time spent recovering since boot
     };
 
     I2CMaster(int sdaPin = I2C_SDA, int sclPin = I2C_SCL, uint32_t freq = I2C_FREQ, bool doBegin = true);
 
+    /// Use a bus backend other than Wire, e.g. I2CBusLinux
+    explicit I2CMaster(I2CBus *bus, bool doBegin = true);
+
     // Must be called from setup and only once
     void begin();
 
@@ -22,12 +40,29 @@ public:
     /// Scan bus, get the unique IDs of the devices
     void scan(bool getIds = false);
 
+    /// Hand out addresses to slaves waiting on I2C_DEFAULT_SLAVE_ADDR.
+    /// Returns the number of slaves moved to their own address
+    uint8_t enumerate();
+
+    /// Forget every persisted unique ID -> address mapping
+    void clearAddressMap();
+
     /// Dump slave info to serial
     void dumpSlaves();
 
     /// Check if a device ACKs its address
     bool probe(uint8_t address);
 
+    /// Raw single byte transfers, used by the legacy text protocol
+    bool writeByte(uint8_t address, uint8_t b);
+    bool readByte(uint8_t address, uint8_t &b);
+
+    /// Free a stuck bus: clock SCL manually, generate a STOP and restart the bus
+    bool recoverBus();
+
+    /// Bus lock-up / recovery counters
+    const I2C_BUS_STATS& getBusStats() const { return _busStats; }
+
     /// Get the number of slave devices found
     uint8_t getFoundSlaveCount();
 
@@ -56,7 +91,12 @@ public:
     bool sendDataBegin(uint8_t address);
 
     /// Send job data
-    bool sendJobData(uint8_t address, const char *previousHashStr, const char *expectedHash, uint8_t difficulty);
+    bool sendJobData(uint8_t address, const Job &job, uint8_t difficulty);
+
+    /// Send job data limited to the nonce range [rangeStart, rangeEnd). Used
+    /// when several slaves share one job
+    bool sendJobData(uint8_t address, const Job &job, uint8_t difficulty,
+        uint32_t rangeStart, uint32_t rangeEnd);
 
     /// Send data
     bool sendData(uint8_t address, const uint8_t *data, const uint8_t len, const uint8_t startSeq = 0);
@@ -67,17 +107,43 @@ public:
     // Get the status of the job and if found the nonce and timings
     bool getJobResult(uint8_t address, uint16_t &foundNonce, uint16_t &timeTakenMs);
 
+    // As above for range jobs, where the nonce can be past 16 bits
+    bool getJobResultRange(uint8_t address, uint32_t &foundNonce, uint16_t &timeTakenMs);
+
+    /// Where the slave is in its search: the nonce it is on and its own
+    /// elapsed time. done is set once the result is ready to collect
+    bool getJobProgress(uint8_t address, uint32_t &currentNonce, uint32_t &elapsedMs, bool &done);
+
+    /// Make the slave drop the job it is working on. True once the slave
+    /// reports it is ready for a new job
+    bool abortJob(uint8_t address);
+
 private:
-    int _sdaPin;
-    int _sclPin;
-    uint32_t _freq;
+    I2CBus *_bus;
     uint16_t _timeout = 300;
 
     static constexpr uint8_t _retries = 2;
+    static constexpr uint8_t _maxCmdLen = 16;   // command byte + data
     static constexpr uint16_t _scanDelayMs = 5;
+    static constexpr uint16_t _enumMaxAttempts = MAX_I2C_WORKERS * 8;
+    static constexpr uint16_t _enumBackoffMs = 300;     // covers the slaves' random 0-255ms back off
+    static constexpr const char* _addrMapNamespace = "i2cmap";
 
+    // Sized for the slaves found, see _allocSlaves()
     uint8_t _slaveCount = 0;
-    I2C_SLAVE _slaves[MAX_I2C_WORKERS];
+    I2C_SLAVE* _slaves = nullptr;
+    uint8_t _slavesAllocated = 0;
+    void _allocSlaves(uint8_t count);
+
+    // Bus lock-up detection. A browned out slave can hold SDA low, after which
+    // every transfer times out. Consecutive timeouts spread over several
+    // addresses (or SDA read low while idle) trigger recoverBus().
+    static constexpr uint8_t _busFailThreshold = 6;
+    static constexpr uint8_t _busFailMinAddrs  = 3;
+    uint8_t  _busFailCount = 0;
+    uint8_t  _busFailAddrCount = 0;
+    uint32_t _busFailAddrs[4] = {0};    // bitmap of addresses in the current failure run
+    I2C_BUS_STATS _busStats;
 
     // Protocol command IDs
     static constexpr uint8_t CMD_VERSION    = 0x02;
@@ -89,10 +155,50 @@ private:
 
     static constexpr uint8_t CMD_GET_JOB_STATUS = 0x32;
     static constexpr uint8_t CMD_GET_JOB_RESULT = 0x33;
+    static constexpr uint8_t CMD_GET_JOB_RESULT32 = 0x34;
+    static constexpr uint8_t CMD_GET_JOB_PROGRESS = 0x35;   // resp: status, nonce32, elapsed ms32
+    static constexpr uint8_t CMD_ABORT_JOB      = 0x36;   // resp: 0xAA ready, else still busy
+
+    // Job frame: prev hash (41, null ended), expected hash (20), difficulty.
+    // A range job appends the nonce range start and end, both 32 bit LE
+    static constexpr uint8_t JOB_FRAME_LEN       = 41+20+1;
+    static constexpr uint8_t JOB_RANGE_FRAME_LEN = JOB_FRAME_LEN + 4 + 4;
+
+    bool _sendJobFrame(uint8_t address, const uint8_t *frame, uint8_t len);
 
     static constexpr uint8_t CMD_GET_UNIQUEID   = 0x40;
+    // Enumeration, only answered on I2C_DEFAULT_SLAVE_ADDR
+    static constexpr uint8_t CMD_ENUM_GET_ID    = 0x41;   // resp: id[8] + crc8
+    static constexpr uint8_t CMD_SET_ADDRESS    = 0x42;   // data: id[8], addr, crc8
+    static constexpr uint8_t CMD_ENUM_BACKOFF   = 0x43;   // slaves go quiet for a random time
+
+    // Persisted unique ID -> address map, kept in NVS
+    struct ADDR_MAP_ENTRY {
+        uint8_t id[8];
+        uint8_t address;
+    };
+    // Grows as devices are seen, up to MAX_I2C_WORKERS entries
+    ADDR_MAP_ENTRY* _addrMap = nullptr;
+    uint8_t _addrMapCount = 0;
+    uint8_t _addrMapSize = 0;
+    bool _addrMapLoaded = false;
 
     bool _sendCmd(uint8_t address, const uint8_t cmd, const uint8_t data[] = nullptr, uint8_t len = 0, bool sendStop = true);
-    // Get response from slave
-    bool _getResponse(uint8_t address, uint8_t respLength, uint8_t data[], bool sendStop = true);
+    // Command and its response as one write/read transfer
+    bool _command(uint8_t address, const uint8_t cmd, const uint8_t data[], uint8_t len, uint8_t resp[], uint8_t respLen);
+    bool _command(uint8_t address, const uint8_t cmd, uint8_t resp[], uint8_t respLen) {
+        return _command(address, cmd, nullptr, 0, resp, respLen);
+    }
+
+    // Address assignment helpers
+    bool _growAddressMap(uint8_t count);
+    void _loadAddressMap();
+    void _saveAddressMap();
+    uint8_t _lookupAddress(const uint8_t id[8]);
+    uint8_t _findFreeAddress(const uint8_t id[8]);
+    bool _assignAddress(const uint8_t id[8], uint8_t address);
+
+    // Bus health bookkeeping
+    void _busOk();
+    void _busTimeout(uint8_t address);
 };
\ No newline at end of file
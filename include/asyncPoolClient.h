@@ -0,0 +1,67 @@
+#pragma once
+#ifndef _ASYNC_POOL_CLIENT_H
+#define _ASYNC_POOL_CLIENT_H
+
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "spscRing.h"
+
+#define POOL_ASYNC_RX_BUFFER  512
+
+// Pool socket on AsyncTCP. Received bytes are put in a ring by the TCP
+// task's callbacks, so checking for data is a couple of loads rather than
+// a socket call, and neither connecting nor reading ever blocks.
+//
+// Mirrors the bits of WiFiClient the pool used. connect() only starts the
+// connection, it's up once connected() and gave up when neither
+// connected() nor connecting().
+//
+// The task that called connect() is notified whenever something arrives,
+// so it can sleep on ulTaskNotifyTake() rather than poll.
+class AsyncPoolClient {
+  public:
+    AsyncPoolClient();
+    ~AsyncPoolClient();
+
+    /// Start connecting, false if it couldn't even be started
+    bool connect(const char *host, uint16_t port, uint32_t timeoutMs);
+    bool connected();
+    /// Still setting up, false again once connected, failed or timed out
+    bool connecting();
+    void stop();
+
+    int available() const { return (int)_rx.size(); }
+    int read(uint8_t *buf, size_t len) { return (int)_rx.pop(buf, len); }
+    size_t write(const uint8_t *buf, size_t len);
+
+    /// Bytes lost because the ring was full
+    uint32_t getOverflowCount() const { return _overflow; }
+
+  private:
+    enum ASYNC_STATE : uint8_t {
+      ASYNC_IDLE,
+      ASYNC_CONNECTING,
+      ASYNC_CONNECTED,
+      ASYNC_FAILED
+    };
+
+    AsyncClient *_client;
+    SpscRing<POOL_ASYNC_RX_BUFFER> _rx;
+    std::atomic<uint8_t> _state;
+    uint32_t _connectStartMs = 0;
+    uint32_t _connectTimeoutMs = 0;
+    std::atomic<uint32_t> _overflow;
+    TaskHandle_t _owner = nullptr;
+
+    // Run in the AsyncTCP task
+    void _wakeOwner();
+    static void _onConnect(void *arg, AsyncClient *c);
+    static void _onDisconnect(void *arg, AsyncClient *c);
+    static void _onError(void *arg, AsyncClient *c, int8_t error);
+    static void _onData(void *arg, AsyncClient *c, void *data, size_t len);
+};
+
+#endif
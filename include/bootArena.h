@@ -0,0 +1,52 @@
+#pragma once
+#ifndef _BOOT_ARENA_H
+#define _BOOT_ARENA_H
+
+#include "config.h"
+#include <atomic>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+// Long-lived objects made at boot (pools, miners, worker tables, tasks)
+// carved out of one static block. They never fragment the heap and show
+// up as one number in the report. Nothing is ever freed, so only for
+// objects that live as long as the firmware. Once the block is full the
+// rest go on the heap and are counted, see BOOT_ARENA_BYTES
+class BootArena {
+  public:
+    static BootArena& instance();
+
+    /// size bytes aligned to align, from the heap once the block is full
+    void* alloc(size_t size, size_t align = alignof(max_align_t));
+
+    template <class T, class... Args>
+    T* make(Args&&... args) {
+      return new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /// count default constructed Ts
+    template <class T>
+    T* makeArray(size_t count) {
+      T* items = static_cast<T*>(alloc(sizeof(T) * count, alignof(T)));
+      for (size_t i = 0; i < count; i++) new (&items[i]) T();
+      return items;
+    }
+
+    // ---- Stats ----
+    size_t getUsed() const { return _used.load(std::memory_order_relaxed); }
+    size_t getCapacity() const { return BOOT_ARENA_BYTES; }
+    uint32_t getOverflowCount() const { return _overflowCount.load(std::memory_order_relaxed); }
+    size_t getOverflowBytes() const { return _overflowBytes.load(std::memory_order_relaxed); }
+
+  private:
+    BootArena() = default;
+
+    alignas(16) static uint8_t _block[BOOT_ARENA_BYTES];
+    std::atomic<size_t> _used{0};
+    std::atomic<uint32_t> _overflowCount{0};
+    std::atomic<size_t> _overflowBytes{0};
+};
+
+#endif
@@ -42,7 +42,88 @@
 #define I2C_SDA     21
 #define I2C_SCL     22
 #define I2C_FREQ    100000UL
-#define MAX_I2C_WORKERS 30
+// Slaves the master looks for. Worker state is allocated for the slaves
+// actually found, a slot only costs a few bytes in the scheduler table.
+// The scan covers addresses 1-126 less the default one, so at most 125,
+// and enumerate() only hands out the 96 in the assign range below
+#ifndef MAX_I2C_WORKERS
+  #define MAX_I2C_WORKERS 30
+#endif
+#if MAX_I2C_WORKERS > 125
+  #error "MAX_I2C_WORKERS can't be more than the 125 addresses the scan covers"
+#endif
+
+// Slaves without an address of their own boot on a shared default address
+// and are handed a free one from the assign range by I2CMaster::enumerate()
+#define I2C_DEFAULT_SLAVE_ADDR  0x77
+#define I2C_ASSIGN_ADDR_FIRST   0x10
+#define I2C_ASSIGN_ADDR_LAST    0x6F
+
+// Slaves per cooperative group. Above 1 the group leader takes one (larger)
+// job from the pool and every member searches its own slice of the nonces
+#ifndef I2C_GROUP_SIZE
+  #define I2C_GROUP_SIZE 1
+#endif
+#ifndef I2C_GROUP_START_DIFF
+  #define I2C_GROUP_START_DIFF "MEGA"
+#endif
+
+// Pool sockets shared by all workers. The pool ties a socket up from a JOB
+// request until the share verdict, so with fewer sockets than workers the
+// workers take turns (see PoolManager). Lower it to save heap and sockets
+#ifndef POOL_MAX_CONNECTIONS
+  #define POOL_MAX_CONNECTIONS MAX_I2C_WORKERS
+#endif
+
+// Pool discovery (getPool) cache. An answer is kept for the TTL, a failed
+// lookup isn't retried before the retry time
+#ifndef POOL_DISCOVERY_TTL_MS
+  #define POOL_DISCOVERY_TTL_MS   (10 * 60 * 1000UL)
+#endif
+#ifndef POOL_DISCOVERY_RETRY_MS
+  #define POOL_DISCOVERY_RETRY_MS (30 * 1000UL)
+#endif
+
+// Pool nodes kept as candidates. Connections spread over the healthy ones,
+// a node that takes longer than POOL_JOB_TIMEOUT_MS to hand out a job, or
+// whose job round trip averages over POOL_RTT_DEGRADED_MS, is failed over
+// and left alone for POOL_NODE_HOLDOFF_MS
+#ifndef POOL_MAX_NODES
+  #define POOL_MAX_NODES          4
+#endif
+#ifndef POOL_JOB_TIMEOUT_MS
+  #define POOL_JOB_TIMEOUT_MS     2000UL
+#endif
+#ifndef POOL_RTT_DEGRADED_MS
+  #define POOL_RTT_DEGRADED_MS    1500UL
+#endif
+#ifndef POOL_NODE_HOLDOFF_MS
+  #define POOL_NODE_HOLDOFF_MS    (30 * 1000UL)
+#endif
+
+// Send the next JOB request in the same write as the share, saving a round
+// trip per share. Can also be switched per pool with Pool::setPipelining()
+#ifndef POOL_PIPELINE
+  #define POOL_PIPELINE 0
+#endif
+
+// Hold each worker's shares back to the job age the pool has been
+// accepting, see sharePacer.h. 0 sends every share as soon as it's found
+#ifndef SHARE_PACING
+  #define SHARE_PACING 1
+#endif
+
+// Static block the long-lived objects are made in at boot, see bootArena.h.
+// Pools are the bulk of it, the report says if it overflowed to the heap
+#ifndef BOOT_ARENA_BYTES
+  #define BOOT_ARENA_BYTES (24 * 1024)
+#endif
+
+// Count heap allocations per task, needs the malloc wrap linker flags in
+// platformio.ini. 2 also asserts on one from a miner task once it's steady
+#ifndef HEAP_TRACK_ALLOCS
+  #define HEAP_TRACK_ALLOCS 0
+#endif
 
 #ifdef SERIAL_PRINT
   #define SERIALBEGIN()             Serial.begin(115200)
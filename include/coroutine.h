@@ -0,0 +1,78 @@
+#pragma once
+#ifndef _COROUTINE_H
+#define _COROUTINE_H
+
+#include <Arduino.h>
+
+// Stackless coroutines, protothread style. A function written between
+// CO_BEGIN and CO_END returns CO_WAITING where it has to wait and carries
+// on from that line on its next call, so a multi-step exchange reads top
+// to bottom without blocking.
+//
+// All a suspended coroutine keeps is the Coroutine below (8 bytes), so
+// locals don't survive a wait, keep what's needed in members. The body
+// can't use a switch of its own, the macros are one, and each wait needs
+// a line to itself.
+//
+//   CoStatus Pool::_greet() {
+//     CO_BEGIN(_co);
+//     CO_AWAIT_FOR(_co, _lineReady(), CLIENT_TIMEOUT_RW);
+//     if (_co.timedOut) CO_EXIT(_co);
+//     ...
+//     CO_END(_co);
+//   }
+
+enum CoStatus : uint8_t {
+  CO_WAITING,         // call again later
+  CO_FINISHED         // ran to the end, the next call starts over
+};
+
+struct Coroutine {
+  uint16_t line = 0;      // where to resume, 0 = from the top
+  bool timedOut = false;  // the last CO_AWAIT_FOR gave up
+  uint32_t sinceMs = 0;   // when the current wait started
+
+  void reset() { line = 0; timedOut = false; }
+  bool isRunning() const { return line != 0; }
+};
+
+#define CO_BEGIN(co)    switch ((co).line) { case 0:
+
+#define CO_END(co)      } (co).line = 0; return CO_FINISHED
+
+/// Leave now, the next call starts over
+#define CO_EXIT(co)     do { (co).line = 0; return CO_FINISHED; } while (0)
+
+/// Give others a go, carry on from here next time
+#define CO_YIELD(co) \
+  do { (co).line = __LINE__; return CO_WAITING; case __LINE__:; } while (0)
+
+/// Wait until cond is true. cond is evaluated once per call, so it can
+/// consume, e.g. take a line from a buffer
+#define CO_AWAIT(co, cond) \
+  do { \
+    (co).sinceMs = millis(); \
+    (co).line = __LINE__; case __LINE__: \
+    if (!(cond)) return CO_WAITING; \
+  } while (0)
+
+/// Wait until cond is true or ms have gone by, timedOut tells which
+#define CO_AWAIT_FOR(co, cond, ms) \
+  do { \
+    (co).sinceMs = millis(); \
+    (co).line = __LINE__; case __LINE__: \
+    (co).timedOut = false; \
+    if (!(cond)) { \
+      if (millis() - (co).sinceMs < (uint32_t)(ms)) return CO_WAITING; \
+      (co).timedOut = true; \
+    } \
+  } while (0)
+
+/// Wait until deadlineMs (a millis() value), wrap safe
+#define CO_AWAIT_DEADLINE(co, deadlineMs) \
+  CO_AWAIT(co, (int32_t)(millis() - (uint32_t)(deadlineMs)) >= 0)
+
+#define CO_SLEEP(co, ms) \
+  CO_AWAIT(co, millis() - (co).sinceMs >= (uint32_t)(ms))
+
+#endif
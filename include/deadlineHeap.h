@@ -0,0 +1,116 @@
+#ifndef _DEADLINE_HEAP_H_
+#define _DEADLINE_HEAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Min-heap of deadlines, at most one per id (0..capacity-1), so the
+// soonest can be found without looking at everyone. Times are wrapping
+// microsecond counts, compared by difference, so every deadline must be
+// within ~35 minutes of the others. No heap allocation.
+template <size_t capacity>
+class DeadlineHeap {
+  static_assert(capacity <= 255, "ids are uint8_t");
+
+public:
+  DeadlineHeap() { clear(); }
+
+  void clear() {
+    count = 0;
+    for (size_t i = 0; i < capacity; i++) pos[i] = -1;
+  }
+
+  /// Set the id's deadline, moving it if it already has one
+  void schedule(uint8_t id, uint32_t dueUs) {
+    if (id >= capacity) return;
+    int16_t i = pos[id];
+    if (i < 0) {
+      i = count++;
+      heap[i].id = id;
+      pos[id] = i;
+    }
+    heap[i].due = dueUs;
+    _siftDown(_siftUp(i));
+  }
+
+  /// Only move the deadline if that makes it sooner
+  void scheduleBy(uint8_t id, uint32_t dueUs) {
+    if (id < capacity && pos[id] >= 0 && !_before(dueUs, heap[pos[id]].due)) return;
+    schedule(id, dueUs);
+  }
+
+  void cancel(uint8_t id) {
+    if (id >= capacity || pos[id] < 0) return;
+    const int16_t i = pos[id];
+    pos[id] = -1;
+    if (i == --count) return;
+    heap[i] = heap[count];
+    pos[heap[i].id] = i;
+    _siftDown(_siftUp(i));
+  }
+
+  bool contains(uint8_t id) const { return id < capacity && pos[id] >= 0; }
+  bool empty() const { return count == 0; }
+  size_t size() const { return count; }
+
+  /// Soonest deadline, false if there is none
+  bool peek(uint8_t &id, uint32_t &dueUs) const {
+    if (count == 0) return false;
+    id = heap[0].id;
+    dueUs = heap[0].due;
+    return true;
+  }
+
+  /// Take the soonest id if it's due by nowUs
+  bool popDue(uint32_t nowUs, uint8_t &id) {
+    if (count == 0 || _before(nowUs, heap[0].due)) return false;
+    id = heap[0].id;
+    cancel(id);
+    return true;
+  }
+
+protected:
+  struct Entry {
+    uint32_t due;
+    uint8_t id;
+  };
+
+  Entry heap[capacity];
+  int16_t pos[capacity];      // index in heap, -1 if not scheduled
+  int16_t count;
+
+  static bool _before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+  int16_t _siftUp(int16_t i) {
+    while (i > 0) {
+      const int16_t parent = (i - 1) / 2;
+      if (!_before(heap[i].due, heap[parent].due)) break;
+      _swap(i, parent);
+      i = parent;
+    }
+    return i;
+  }
+
+  void _siftDown(int16_t i) {
+    for (;;) {
+      const int16_t l = 2 * i + 1;
+      const int16_t r = l + 1;
+      int16_t least = i;
+      if (l < count && _before(heap[l].due, heap[least].due)) least = l;
+      if (r < count && _before(heap[r].due, heap[least].due)) least = r;
+      if (least == i) return;
+      _swap(i, least);
+      i = least;
+    }
+  }
+
+  void _swap(int16_t a, int16_t b) {
+    const Entry t = heap[a];
+    heap[a] = heap[b];
+    heap[b] = t;
+    pos[heap[a].id] = a;
+    pos[heap[b].id] = b;
+  }
+};
+
+#endif // _DEADLINE_HEAP_H_
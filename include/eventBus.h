@@ -0,0 +1,84 @@
+#pragma once
+#ifndef _EVENT_BUS_H
+#define _EVENT_BUS_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#define EVENT_BUS_CAPACITY        64      // power of two
+#define EVENT_BUS_MAX_SUBSCRIBERS 6
+#define EVENT_TEXT_LEN            44      // fits a 40 char seed
+
+enum BusSource : uint8_t {
+  BUS_POOL,           // type is a PoolEvent
+  BUS_MINER           // type is a MinerEvent
+};
+
+// One event, fixed size so publishing is a handful of stores. What a, b
+// and c hold depends on the event, see where it's published
+struct BusEvent {
+  uint32_t ms;                    // millis() when published
+  uint8_t source;                 // BusSource
+  uint8_t type;
+  uint8_t address;                // the worker's slave address, 0 for the master
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+  char text[EVENT_TEXT_LEN];      // truncated copy
+};
+
+typedef void (*BusHandler)(const BusEvent &ev, void *user);
+
+// Events from the mining path to whoever wants them (serial, LED, web...)
+// without the mining path waiting on any of them.
+//
+// publish() copies the event into a preallocated ring and never blocks or
+// allocates, from any task. Each subscriber has its own cursor and drains
+// at its own pace. One that falls more than a ring behind loses the
+// oldest events, which it sees in its overflow count.
+class EventBus {
+  public:
+    static EventBus& instance();
+
+    void publish(uint8_t source, uint8_t type, uint8_t address,
+                 uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, const char *text = nullptr);
+
+    /// A cursor starting at the next event, -1 when all are taken. name
+    /// must outlive the bus
+    int8_t subscribe(const char *name);
+    /// Hand up to max of the subscriber's events to handler. Only ever
+    /// from one task per subscriber. Returns the number handed over
+    size_t drain(int8_t sub, BusHandler handler, void *user = nullptr, size_t max = EVENT_BUS_CAPACITY);
+
+    // ---- Stats ----
+    uint32_t getPublishedCount() const { return _head.load(std::memory_order_relaxed); }
+    uint8_t getSubscriberCount() const { return _numSubs.load(std::memory_order_acquire); }
+    const char* getSubscriberName(int8_t sub) const;
+    uint32_t getOverflowCount(int8_t sub) const;
+
+  private:
+    EventBus();
+
+    // seq is index + 1 once the event at index is written, 0 while it's
+    // being written
+    struct _Slot {
+      std::atomic<uint32_t> seq;
+      BusEvent ev;
+    };
+
+    struct _Subscriber {
+      const char* name;
+      uint32_t cursor;                    // next index to read, owned by the draining task
+      std::atomic<uint32_t> overflow;
+      std::atomic<bool> ready;            // set up, can be counted in _numSubs
+    };
+
+    _Slot _slots[EVENT_BUS_CAPACITY];
+    std::atomic<uint32_t> _head{0};       // next index to publish
+    _Subscriber _subs[EVENT_BUS_MAX_SUBSCRIBERS];
+    std::atomic<uint8_t> _claimedSubs{0};  // slots handed out by subscribe()
+    std::atomic<uint8_t> _numSubs{0};      // slots set up, what readers go by
+};
+
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+#ifndef _HEAP_STATS_H
+#define _HEAP_STATS_H
+
+#include "config.h"
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HEAP_STATS_MAX_TASKS 6
+
+// Heap health for long uptimes. Free heap alone hides fragmentation, the
+// largest free block is what decides whether the next connect or TLS
+// handshake gets its buffers.
+//
+// With HEAP_TRACK_ALLOCS (and the malloc wrap linker flags, see
+// platformio.ini) every allocation is counted against the task making it.
+// After markSteady() a strict task isn't expected to allocate at all,
+// outside of an Allow scope (reconnects and the like). Those that do are
+// counted with the caller's address, or assert with HEAP_TRACK_ALLOCS 2.
+class HeapStats {
+  public:
+    static HeapStats& instance();
+
+    struct Snapshot {
+      uint32_t freeBytes;
+      uint32_t largestBlock;
+      uint32_t minFreeEver;
+    };
+    void snapshot(Snapshot &out) const;
+
+    /// Count the task's allocations under name, from setup(). name must
+    /// outlive us
+    bool track(const char *name, void *task, bool strict = false);
+    /// Boot is over, strict tasks shouldn't allocate from here on
+    void markSteady() { _steady.store(true, std::memory_order_release); }
+    bool isSteady() const { return _steady.load(std::memory_order_acquire); }
+
+    /// Allocations on this task are expected while one is in scope
+    class Allow {
+      public:
+        Allow();
+        ~Allow();
+      private:
+        int8_t _slot;
+    };
+
+    // ---- Stats ----
+    uint8_t getTaskCount() const { return _count.load(std::memory_order_acquire); }
+    const char* getTaskName(uint8_t i) const { return i < getTaskCount() ? _tasks[i].name : nullptr; }
+    uint32_t getAllocCount(uint8_t i) const { return i < getTaskCount() ? _tasks[i].allocs : 0; }
+    uint32_t getSteadyAllocCount(uint8_t i) const { return i < getTaskCount() ? _tasks[i].steadyAllocs : 0; }
+    uintptr_t getLastSteadyCaller(uint8_t i) const { return i < getTaskCount() ? _tasks[i].lastCaller : 0; }
+    uint32_t getOtherAllocCount() const { return _otherAllocs.load(std::memory_order_relaxed); }
+
+    /// From the malloc wrappers
+    void onAlloc(void *caller);
+
+  private:
+    HeapStats() = default;
+    static HeapStats _instance;
+
+    // Only ever written by their own task once tracked
+    struct _Task {
+      const char* name;
+      void* task;
+      bool strict;
+      uint8_t allowDepth;
+      uint32_t allocs;
+      uint32_t steadyAllocs;
+      uintptr_t lastCaller;
+    };
+
+    _Task _tasks[HEAP_STATS_MAX_TASKS] = {};
+    std::atomic<uint8_t> _count{0};
+    std::atomic<bool> _steady{false};
+    std::atomic<uint32_t> _otherAllocs{0};
+
+    int8_t _find(void *task) const;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#pragma once
+#ifndef _HTTP_SERVICE_H
+#define _HTTP_SERVICE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+// status is the HTTP code, or <= 0 if the request never got an answer
+typedef void (*HttpCallback)(int status, const String& body, void *user);
+
+// Background HTTPS GETs over one kept-alive connection.
+//
+// get() queues the request and returns at once, a worker task does the
+// TLS and transfer and the callback is run from loop() in the task that
+// queued it, which is notified when its answer is ready. Only tasks that
+// run loop() for good (the task runners) can use get(), each has its own
+// answer queue. fetch() is the blocking version for code that already
+// runs in its own task. Consecutive requests to the same host reuse the
+// open connection rather than handshaking again.
+class HttpService {
+  public:
+    static HttpService& instance();
+
+    /// Once, from setup() before any task uses it
+    void begin();
+    /// Deliver the calling task's finished requests to their callbacks. A
+    /// task's first call signs it up for get()
+    void loop();
+
+    /// Queue a GET, false if the queue is full or the calling task doesn't
+    /// run loop()
+    bool get(const String &url, HttpCallback cb, void *user = nullptr);
+    /// Blocking GET, not for the mining loop
+    int fetch(const String &url, String &body);
+
+    // ---- Stats ----
+    uint32_t getRequestCount() const { return _requests; }
+    uint32_t getReuseCount() const { return _reused; }
+    uint32_t getFailCount() const { return _failed; }
+
+  private:
+    HttpService() {}
+
+    struct _Request {
+      String url;
+      HttpCallback cb;
+      void* user;
+      uint8_t owner;      // _owners index
+      int status;
+      String body;
+    };
+
+    // A task running loop() and the answers waiting for it. Slots are
+    // filled in order and never given back
+    struct _Owner {
+      TaskHandle_t task = nullptr;
+      QueueHandle_t done = nullptr;     // _Request*, back to its loop()
+    };
+    static constexpr uint8_t _maxOwners = 4;
+
+    QueueHandle_t _pending = nullptr;   // _Request*, to the worker
+    SemaphoreHandle_t _lock = nullptr;  // one request on the connection at a time
+    SemaphoreHandle_t _ownersLock = nullptr;
+    TaskHandle_t _task = nullptr;
+    _Owner _owners[_maxOwners];
+    std::atomic<uint8_t> _numOwners{0};
+
+    String _lastHost;
+    uint32_t _lastUseMs = 0;
+    uint32_t _requests = 0;
+    uint32_t _reused = 0;
+    uint32_t _failed = 0;
+
+    int8_t _findOwner(TaskHandle_t task) const;
+    int8_t _addOwner(TaskHandle_t task);
+    static void _taskMain(void *arg);
+    int _perform(const String &url, String &body);
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Minimal I2C bus interface so the master logic isn't tied to the Arduino
+// Wire global. Kept free of Arduino headers so host backends can use it.
+//
+// Results use the Wire.endTransmission() codes so existing error handling
+// and logging carry over unchanged.
+class I2CBus {
+public:
+    enum I2C_BUS_RESULT : uint8_t {
+        I2C_BUS_OK          = 0,
+        I2C_BUS_ERR_LENGTH  = 1,    // too long for the transmit buffer
+        I2C_BUS_ERR_NACK    = 2,    // address NACK'd, nobody home
+        I2C_BUS_ERR_DATA    = 3,    // data NACK'd
+        I2C_BUS_ERR_OTHER   = 4,
+        I2C_BUS_ERR_TIMEOUT = 5
+    };
+
+    virtual ~I2CBus() {}
+
+    virtual bool begin() = 0;
+    virtual void end() = 0;
+    virtual void setTimeout(uint16_t timeoutMs) = 0;
+
+    /// Write len bytes. A zero length write only addresses the device
+    virtual uint8_t write(uint8_t address, const uint8_t *data, size_t len, bool sendStop = true) = 0;
+
+    /// Read exactly len bytes
+    virtual uint8_t read(uint8_t address, uint8_t *data, size_t len) = 0;
+
+    /// Write then read with a repeated start in between
+    virtual uint8_t writeRead(uint8_t address, const uint8_t *wdata, size_t wlen, uint8_t *rdata, size_t rlen) = 0;
+
+    /// Check if a device ACKs its address
+    virtual bool probe(uint8_t address) { return write(address, nullptr, 0) == I2C_BUS_OK; }
+
+    /// Free a bus a slave is holding, leaves the bus ready for use.
+    /// Returns true if SDA is released afterwards
+    virtual bool recover() { return false; }
+
+    /// True if SDA is being held low while the bus should be idle
+    virtual bool sdaStuckLow() { return false; }
+};
+
+#endif // I2C_BUS_H
@@ -0,0 +1,34 @@
+#ifndef I2C_BUS_LINUX_H
+#define I2C_BUS_LINUX_H
+
+#if defined(__linux__)
+
+#include "i2c_bus.h"
+
+// Linux i2c-dev backend for driving the slaves from an SBC. Every transfer,
+// including a combined write/read, is one ioctl(I2C_RDWR) so a repeated
+// start costs a single syscall. Works against i2c-stub for host testing.
+class I2CBusLinux : public I2CBus {
+public:
+    /// busNum selects /dev/i2c-<busNum>
+    explicit I2CBusLinux(int busNum);
+    ~I2CBusLinux() override;
+
+    bool begin() override;
+    void end() override;
+    void setTimeout(uint16_t timeoutMs) override;
+
+    uint8_t write(uint8_t address, const uint8_t *data, size_t len, bool sendStop = true) override;
+    uint8_t read(uint8_t address, uint8_t *data, size_t len) override;
+    uint8_t writeRead(uint8_t address, const uint8_t *wdata, size_t wlen, uint8_t *rdata, size_t rlen) override;
+
+private:
+    int _busNum;
+    int _fd = -1;
+    uint16_t _timeout = 300;
+
+    uint8_t _transfer(void *msgs, unsigned int count);
+};
+
+#endif // __linux__
+#endif // I2C_BUS_LINUX_H
@@ -0,0 +1,32 @@
+#ifndef I2C_BUS_WIRE_H
+#define I2C_BUS_WIRE_H
+
+#include "i2c_bus.h"
+#include <Arduino.h>
+#include <Wire.h>
+
+// ESP32 Arduino Wire backend
+class I2CBusWire : public I2CBus {
+public:
+    I2CBusWire(int sdaPin, int sclPin, uint32_t freq, TwoWire &wire = Wire);
+
+    bool begin() override;
+    void end() override;
+    void setTimeout(uint16_t timeoutMs) override;
+
+    uint8_t write(uint8_t address, const uint8_t *data, size_t len, bool sendStop = true) override;
+    uint8_t read(uint8_t address, uint8_t *data, size_t len) override;
+    uint8_t writeRead(uint8_t address, const uint8_t *wdata, size_t wlen, uint8_t *rdata, size_t rlen) override;
+
+    bool recover() override;
+    bool sdaStuckLow() override;
+
+private:
+    TwoWire &_wire;
+    int _sdaPin;
+    int _sclPin;
+    uint32_t _freq;
+    uint16_t _timeout = 300;
+};
+
+#endif // I2C_BUS_WIRE_H
@@ -0,0 +1,31 @@
+#ifndef _JOB_H
+#define _JOB_H
+
+#include <Arduino.h>
+#include <string.h>
+#include "utils.h"
+
+// One pool job, decoded once when it arrives and then passed around by
+// reference. Fixed layout, no heap
+struct Job {
+  char seedHex[41];       // previous hash as sent, what gets hashed
+  char targetHex[41];     // expected hash as sent, stock slaves want it as text
+  uint8_t seed[20];
+  uint8_t target[20];     // what the hash is compared against
+  uint16_t difficulty;
+  uint32_t id;            // 0 = no job
+};
+
+/// Fill a job from the pool's hex fields, both must be 40 chars
+inline void decodeJob(Job &job, const char *seed40, const char *target40, uint16_t difficulty, uint32_t id) {
+  memcpy(job.seedHex, seed40, 40);
+  job.seedHex[40] = '\0';
+  memcpy(job.targetHex, target40, 40);
+  job.targetHex[40] = '\0';
+  hexStringToUint8Array(job.seedHex, job.seed, 20);
+  hexStringToUint8Array(job.targetHex, job.target, 20);
+  job.difficulty = difficulty;
+  job.id = id;
+}
+
+#endif  // _JOB_H
@@ -0,0 +1,104 @@
+#ifndef _LINE_FRAMER_H_
+#define _LINE_FRAMER_H_
+
+#include <Arduino.h>
+#include <string.h>
+
+// Splits a byte stream into '\n' terminated lines in a fixed ring buffer,
+// no heap. '\r' is dropped. A line longer than the caller's buffer is
+// thrown away whole rather than handed out in pieces.
+template <size_t capacity>
+class LineFramer {
+
+public:
+  LineFramer() { clear(); }
+
+  void clear() {
+    head = 0;
+    count = 0;
+    overflowed = false;
+  }
+
+  /// Pull whatever the client has into the ring, returns the bytes taken.
+  /// Any client with available() and read(buf, len) will do
+  template <class Client>
+  size_t feed(Client &client) {
+    size_t taken = 0;
+    while (count < capacity) {
+      const int avail = client.available();
+      if (avail <= 0) break;
+      // Read straight into the free run at the tail
+      const size_t tail = (head + count) % capacity;
+      size_t run = (tail >= head || count == 0) ? capacity - tail : head - tail;
+      if (run > capacity - count) run = capacity - count;
+      if (run > (size_t)avail) run = avail;
+      const int n = client.read((uint8_t *)buffer + tail, run);
+      if (n <= 0) break;
+      count += n;
+      taken += n;
+    }
+    return taken;
+  }
+
+  /// Copy the next complete line into out (nul terminated, without the
+  /// '\n'). Returns the length or -1 if no whole line is buffered yet
+  int nextLine(char *out, size_t outSize) {
+    for (;;) {
+      size_t len = 0;
+      bool found = false;
+      for (; len < count; len++) {
+        if (buffer[(head + len) % capacity] == '\n') { found = true; break; }
+      }
+      if (!found) {
+        // A full ring with no newline can never complete, drop it
+        if (count == capacity) { overflowed = true; clear(); }
+        return -1;
+      }
+
+      // '\r' never reaches out, so it doesn't count against its size
+      size_t textLen = 0;
+      for (size_t i = 0; i < len; i++) {
+        if (buffer[(head + i) % capacity] != '\r') textLen++;
+      }
+
+      size_t outLen = 0;
+      const bool fits = textLen < outSize;
+      for (size_t i = 0; i < len; i++) {
+        const char c = buffer[(head + i) % capacity];
+        if (c == '\r' || !fits) continue;
+        out[outLen++] = c;
+      }
+      head = (head + len + 1) % capacity;
+      count -= len + 1;
+
+      if (fits) {
+        out[outLen] = '\0';
+        return outLen;
+      }
+      overflowed = true;    // too long, skip to the next one
+    }
+  }
+
+  /// Whatever is buffered, complete lines or not, e.g. for a MOTD
+  size_t drain(char *out, size_t outSize) {
+    size_t n = 0;
+    while (count > 0 && n + 1 < outSize) {
+      out[n++] = buffer[head];
+      head = (head + 1) % capacity;
+      count--;
+    }
+    if (outSize > 0) out[n] = '\0';
+    return n;
+  }
+
+  inline size_t size() const { return count; }
+  inline bool hasOverflowed() const { return overflowed; }
+
+protected:
+  char buffer[capacity];
+  size_t head;
+  size_t count;
+  bool overflowed;
+};
+
+#endif // _LINE_FRAMER_H_
@@ -2,8 +2,14 @@
 #define MINER_CLIENT_H
 
 #include "pool.h"
+#include "poolManager.h"
 #include "I2CMaster.h"
+#include "wirewrap.h"
 #include "runevery.h"
+#include "sharePacer.h"
+#include "mpscQueue.h"
+#include "deadlineHeap.h"
+#include "eventBus.h"
 
 #include <DSHA1.h>
 #include <Arduino.h>
@@ -34,9 +40,19 @@ struct MinerEventData {
   float    hashrate_khs = 0.0f;
 };
 
-// C-style callback to avoid pulling in <functional>
+// --- Commands, for other tasks to post ---
+enum MinerCommand : uint8_t {
+  MC_START_MINING,
+  MC_STOP_MINING,
+  MC_SHUTDOWN
+};
+
+// C-style callback to avoid pulling in <functional>. Runs on the miner's
+// task, anything slow should subscribe to the EventBus instead
 typedef void (*MinerEventCallback)(MinerEvent ev, const MinerEventData& data);
 
+// Everything but post() belongs to the task running loop(), other tasks
+// only ever hand it commands
 class MinerClient {
   public:
     MinerClient(const String username, bool isMaster);
@@ -48,9 +64,16 @@ class MinerClient {
     void onEvent(MinerEventCallback cb);
     void reset();
     void setMining(bool flag = true);
+    // Stop mining and make every slave drop its job, e.g. before an OTA update
+    void shutdown();
     bool setupSlaves();
 
-    void loop();
+    /// One pass over the workers that are due, returns the ms until the
+    /// next one is
+    uint32_t loop();
+    /// Queue a command for loop(), from any task. False if the queue is full
+    bool post(MinerCommand cmd);
+    bool findNonce(const Job &job, uint32_t diff, uint32_t &nonce_found, uint32_t &elapsed_time_us);
     bool findNonce(const char *seed40, const char *target40, uint32_t diff, uint32_t &nonce_found, uint32_t &elapsed_time_us);
 
   private:
@@ -62,7 +85,17 @@ class MinerClient {
       DUINO_STATE_JOB_WAIT,
       DUINO_STATE_MINING,
       DUINO_STATE_MINING_I2C,
+      DUINO_STATE_GROUP_WAIT,       // group leader waiting on its members
+      DUINO_STATE_SHARE_HOLD,       // share found, paced until holdUntilMs
       DUINO_STATE_SHARE_SUBMITTED,
+      DUINO_STATE_QUARANTINE,       // sitting out until quarantineUntilMs
+    };
+
+    enum HEALTH_EVENT : uint8_t {
+      HEALTH_OK,                    // a good result
+      HEALTH_TIMEOUT,               // stuck, stalled or overdue
+      HEALTH_BAD_RESULT,            // wrong or missing nonce, failed transfer
+      HEALTH_REJECTED               // share rejected by the pool
     };
 
     // config / identity
@@ -74,38 +107,99 @@ class MinerClient {
     RunEvery _reportTimer = RunEvery(30 * 1000);
 
     I2CMaster* _i2c = nullptr;
-    int _numMinerClients;
+    PoolManager* _pools = nullptr;
+    int _numMinerClients = 0;
+
+    // Counters only the report reads, kept away from the polled fields
+    struct WorkerStats
+    {
+      uint32_t startTimeMs = 0;
+      uint32_t share_count = 0;
+      uint32_t good_count = 0;
+      uint32_t block_count = 0;
+      uint32_t bad_count = 0;
+      uint32_t abort_count = 0;
+      uint32_t abandoned_ms = 0;   // slave hashing time thrown away by aborts
+      uint32_t stall_count = 0;
+      uint32_t held_count = 0;     // shares the pacer held back
+      uint32_t local_reject_count = 0; // slave results caught before the pool saw them
+      uint32_t status_polls = 0;   // result polls on the bus
+      uint32_t fault_count = 0;
+      uint32_t quarantine_count = 0;
+      uint32_t pickup_ms = 0;      // results waiting on the slave to be asked for
+      uint32_t pickup_count = 0;
+
+      uint16_t lowestHashWithError = INT16_MAX;
+      uint16_t highestHashWithError = 0;
+    };
+
+    // The job being worked and the share pacer, only touched when a job
+    // comes in or a share goes out
+    struct WorkerJob
+    {
+      Job job = {};                 // copied from the pool, which may move on to another worker
+      SharePacer pacer;
+    };
+
+    // What the scheduler and the state machine touch on every pass. Widest
+    // fields first so nothing is padded
     struct ClientStruct
     {
-      Pool* _pool = nullptr;      
-      uint8_t _address;
+      MinerClient* _miner = nullptr;  // for the pool event sink
+      Pool* _pool = nullptr;      // the pool connection while leased
+      WireWrapSlave* legacy = nullptr;    // stock firmware slaves only
+      WorkerStats* stats = nullptr;
+      WorkerJob* work = nullptr;
       uint32_t  _stateStartMS = 0;
-      enum DUINO_STATE _state = DUINO_STATE_NONE;
-      unsigned long _jobStartTime;
-      char seed[41] = {0};
-      char target[41] = {0};
-      uint32_t diff = 0;
+      uint32_t _jobStartTime = 0;
       uint32_t lastNonce = 0;
-      uint16_t lastTimeTakenMs = 0;
       float lastHashRate = 0;
-      // How often the slave should be pinged to check for a result
-      RunEvery slaveMiningStatusTimer = RunEvery(40);
-      // Minimum time to re-request job from the pool
-      RunEvery slaveJobReqTimer = RunEvery(25);
 
-      // Stats
-      uint32_t startTimeMs = 0;
-      uint32_t stats_share_count = 0;
-      uint32_t stats_good_count = 0;
-      uint32_t stats_block_count = 0;
-      uint32_t stats_bad_count = 0;
+      // Share pacing
+      uint32_t heldNonce = 0;
+      uint32_t heldElapsedUs = 0;
+      uint32_t holdUntilMs = 0;
+      // Live progress from the slave, polled far less often than the status
+      uint32_t nextProgressUs = 0;
+      uint32_t rangeStart = 0;              // nonce slice being searched
+      uint32_t rangeEnd = 0;
+      uint32_t progressNonce = 0;
+      uint32_t progressAdvanceMs = 0;       // when the slave's nonce last moved
+      uint32_t estimatedFinishMs = 0;       // when the slice will be exhausted
+      float liveHashRate = 0;
+      float estHashRate = 0;                // running average over results, 0 until the first
 
-      uint16_t lowestHashWithError = INT16_MAX;
-      uint16_t highestHashWithError = 0;
+      // Health, see _healthEvent()
+      float health = 1.0f;
+      uint32_t quarantineUntilMs = 0;       // 0 when not quarantined
+
+      uint16_t lastTimeTakenMs = 0;
+      int16_t poolSlot = -1;        // PoolManager worker, -1 for group members
+      enum DUINO_STATE _state = DUINO_STATE_NONE;
+      uint8_t _address = 0;
+      bool jobOutstanding = false;  // JOB sent on the lease, no share yet
+      bool leaseSubmitted = false;  // a share went out on the lease
+      uint8_t verifyFailures = 0;   // slave results for this job that didn't hash to the target
+      uint8_t quarantines = 0;      // since it was last fully healthy, sets the backoff
+      uint8_t pendingRejects = 0;   // from the pool, not yet counted
+
+      // Cooperative groups (I2C_GROUP_SIZE > 1). The leader owns the pool
+      // connection, members only search their slice of the leader's job
+      uint8_t groupLeader = 0;
+      uint8_t groupSize = 1;        // leader only, includes itself
+      uint8_t groupPending = 0;     // leader only, members still searching
     };
-    
-    ClientStruct _clients[MAX_I2C_WORKERS];
+
+    // Sized for the workers found, see _allocClients()
+    ClientStruct* _clients = nullptr;
+    WorkerStats* _stats = nullptr;
+    WorkerJob* _work = nullptr;
+    uint8_t _numAllocated = 0;
     bool _isMining = false;
+    MpscQueue<MinerCommand, 8> _commands;
+    // When each worker next needs a look, a worker in NONE has none
+    DeadlineHeap<MAX_I2C_WORKERS> _schedule;
+    uint32_t _nowUs = 0;            // start of the current pass
     DSHA1 *_dsha1;
 
     // hashrate calc
@@ -119,19 +213,62 @@ class MinerClient {
     MinerEventCallback _cb = nullptr;
 
     void _setState(DUINO_STATE state, int idx);
+    void _runWorker(int idx);
+    void _runIn(int idx, uint32_t ms);
+    void _scheduleNext(int idx);
+    void _wake(int idx);
+    uint32_t _pollIntervalMs(int idx);
+    uint32_t _statusPollMs(int idx);
+    void _notePickup(int idx, uint32_t hashes, uint16_t slaveMs);
+
+    // Health
+    bool _healthEvent(int idx, HEALTH_EVENT ev);
+    bool _isQuarantined(int idx);
+    bool _isOverdue(int idx);
     bool _isStateStuck(int idx);
 
     static void _poolEventSink(PoolEvent ev, const PoolEventData& d, void *user);
+
+    // Pool connection leases
+    void _allocClients(uint8_t count);
+    bool _acquirePool(int idx);
+    void _releasePool(int idx);
+    bool _submitShare(int idx, uint32_t foundNonce, uint32_t elapsedUs);
+    // Submit now or hold the share until the pacer lets it go
+    void _queueShare(int idx, uint32_t foundNonce, uint32_t elapsedUs);
+    void _releaseShare(int idx);
     
-    bool _solveAndSubmit(const char *seed40, const char *target40, uint32_t diff);
+    bool _solveAndSubmit(const Job &job, uint32_t diff);
+
+    // Preempt the slave's job (if any) and account for the lost work
+    void _abortSlaveJob(int idx);
+    void _submitSlaveResult(int idx, uint32_t foundNonce);
+    // One DSHA1 of the nonce against the job's target
+    bool _verifyNonce(const Job &job, uint32_t nonce);
+    bool _checkSlaveResult(int idx, uint32_t foundNonce);
+    void _pollLegacy(int idx);
+    // Drop the worker's (or its group's) job and go back for a new one
+    void _resetWorker(int idx);
+    // The job can't be finished, give up the connection it came on
+    void _dropJob(int idx);
+    // Poll slave progress, returns false if the slave stalled and was reset
+    bool _updateProgress(int idx);
+    void _startProgress(int idx, uint32_t rangeStart, uint32_t rangeEnd);
+
+    // Cooperative groups
+    void _dispatchGroupJob(int leaderIdx);
+    void _groupMemberDone(int idx, uint32_t foundNonce);
+    void _abortGroup(int leaderIdx, int exceptIdx = -1);
 
     bool _max_micros_elapsed(unsigned long current, unsigned long max_elapsed);
     void _handleSystemEvents();
+    void _runCommands();
 
     void _printReport();
 
     // Event functions
     inline void _emit(MinerEvent ev, const MinerEventData& d) {
+      EventBus::instance().publish(BUS_MINER, ev, 0, d.nonce, (uint32_t)(d.hashrate_khs * 1000.0f), 0, d.text);
       if (_cb) _cb(ev, d);
     }
 
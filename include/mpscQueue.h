@@ -0,0 +1,72 @@
+#ifndef _MPSC_QUEUE_H_
+#define _MPSC_QUEUE_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded lock free queue of T for any number of producers and one
+// consumer, e.g. commands posted to a task from wherever. Every slot
+// carries a sequence number so producers claim slots with one CAS and the
+// consumer knows when a claimed slot is actually written. capacity must
+// be a power of two. Kept free of Arduino headers for host builds.
+template <class T, size_t capacity>
+class MpscQueue {
+  static_assert(capacity >= 2 && (capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+  MpscQueue() {
+    for (size_t i = 0; i < capacity; i++) slots[i].seq.store(i, std::memory_order_relaxed);
+    head = 0;
+    tail.store(0, std::memory_order_relaxed);
+  }
+
+  /// Producers. False if the queue is full
+  bool push(const T &item) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    for (;;) {
+      Slot &slot = slots[pos & (capacity - 1)];
+      const size_t seq = slot.seq.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          slot.item = item;
+          slot.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0) {
+        return false;     // the consumer hasn't freed this slot yet
+      }
+      else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Consumer only. False if nothing is ready
+  bool pop(T &out) {
+    Slot &slot = slots[head & (capacity - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != head + 1) return false;
+    out = slot.item;
+    slot.seq.store(head + capacity, std::memory_order_release);
+    head++;
+    return true;
+  }
+
+  bool empty() const {
+    return slots[head & (capacity - 1)].seq.load(std::memory_order_acquire) != head + 1;
+  }
+
+protected:
+  struct Slot {
+    std::atomic<size_t> seq;
+    T item;
+  };
+
+  Slot slots[capacity];
+  size_t head;                  // consumer owned
+  std::atomic<size_t> tail;     // claimed by producers
+};
+
+#endif // _MPSC_QUEUE_H_
@@ -4,7 +4,8 @@
 #include <Arduino.h>
 
 void wifi_setup();
-void ota_setup();
+// onStart is called before an update begins, e.g. to stop the miners
+void ota_setup(void (*onStart)() = nullptr);
 void mdns_setup();
 
 String http_get_string(String URL);
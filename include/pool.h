@@ -2,20 +2,24 @@
 #ifndef _POOL_H
 #define _POOL_H
 
-#include <WiFiClient.h>
+#include "config.h"
+#include "runevery.h"
+#include "lineFramer.h"
+#include "coroutine.h"
+#include "job.h"
+#include "asyncPoolClient.h"
 #include <Arduino.h>
 
 enum DeviceType : uint8_t {
   DEVICE_SLAVE,
   DEVICE_AVR,
+  DEVICE_AVR_GROUP,     // several AVRs splitting one job
   DEVICE_ESP32
 };
 
-struct Job {
-  String prevHash;
-  String expectedHash;
-  uint16_t difficulty;
-};
+#define POOL_RX_BUFFER  256
+#define POOL_LINE_MAX   128
+
 
 enum PoolEvent : uint8_t {
   POOLEVT_CONNECTED,        // payload: text = "host:port"
@@ -43,7 +47,7 @@ class Pool {
 
     void setup();     // connect/register with DuinoCoin pool(s)
     void loop();
-    bool update();   // fetch new pool info from server
+    bool update();   // pool node from the shared discovery cache
     bool connect();
     bool disconnect();
 
@@ -51,12 +55,21 @@ class Pool {
     bool requestMOTD();
     bool requestJob();
     Job* getJob();
-    bool submitJob(uint32_t foundNonce, uint32_t elapsedTimeUS, String workerId = "");
+    bool submitJob(uint32_t foundNonce, uint32_t elapsedTimeUS, const char *workerId = nullptr);
+    // Submit and ask for the next job in one write. The verdict is handled
+    // as usual, then the pool goes straight on to wait for the job
+    bool submitJobAndRequest(uint32_t foundNonce, uint32_t elapsedTimeUS, const char *workerId = nullptr);
 
     bool isConnected();
+    // Nothing in flight, ready for the next request
+    bool isIdle();
     void setUsername(String un);
-    void setMinerName(String minerName);
+    // Worker type, sets the starting difficulty and app name
+    void setDeviceType(DeviceType type);
+    void setMinerName(const char *minerName);
     void setWorkerId(String workerId = "Auto");
+    void setPipelining(bool flag) { _pipelining = flag; }
+    bool isPipelining() const { return _pipelining; }
 
     void setMiningKey(String new_mining_key);
 
@@ -76,22 +89,37 @@ class Pool {
     int _port = 0;
     String _username;
     String _miningKey = "None";
-    String _appName;      // the app name to send when submitting job
+    const char* _appName = "";    // the app name to send when submitting job, shared
 
     DeviceType _type;
     String _minerName = "";
     String _workerId = "";
     String _poolVersion;
     String _MOTD;
-    String _startingDifficulty;
+    const char* _startingDifficulty = "";
 
-    WiFiClient _client;   // not wifi but the TCP client to the pool
+    AsyncPoolClient _client;   // the TCP connection to the pool
     unsigned long _poolConnectTime = 0;
     uint32_t _lastConnectTry = 0;
     uint8_t _tryCount = 0;
     uint32_t lastAttempt = 0;
 
-    Job _poolJob;
+    Job _poolJob = {};
+
+    // Protocol I/O, all in fixed buffers so a share costs no heap
+    LineFramer<POOL_RX_BUFFER> _rx;
+    char _line[POOL_LINE_MAX];          // last line taken from _rx
+    char _jobAcc[POOL_LINE_MAX];        // job triplet, may come over several lines
+    size_t _jobAccLen = 0;
+    char _jobLine[POOL_LINE_MAX];       // preformatted JOB request, with '\n'
+    size_t _jobLineLen = 0;
+    char _submitTail[POOL_LINE_MAX];    // ",app,miner,DUCOID<id>\n" after nonce and hashrate
+    int8_t _node = -1;              // PoolDiscovery node we're using
+    uint32_t _connectStartMs = 0;
+    uint32_t _jobRequestMs = 0;
+    RunEvery _nodeCheck = RunEvery(1000);
+    bool _pipelining = POOL_PIPELINE;
+    bool _jobRequested = false;     // a JOB went out with the last share
 
     // Error
     String _last_err;
@@ -121,18 +149,38 @@ class Pool {
     // state
     enum DUINO_POOL_STATE _state = POOL_STATE_NONE;
     uint32_t  _stateStartMS = 0;
+    Coroutine _co;                  // the exchange in progress
 
     void _setState(DUINO_POOL_STATE state);
+    // Start an exchange, its coroutine runs from the top
+    void _begin(DUINO_POOL_STATE state);
     bool _isStateStuck();
 
+    // Exchanges, each a coroutine on _co run by loop()
+    CoStatus _greet();
+    CoStatus _readMotd();
+    CoStatus _exchange();
+
     // I/O helpers
-    bool _sendLine(const String& s);
-    bool _readLine(String& out, uint32_t timeout_ms);
-    bool _splitTripletCSV(const String& s, String& a, String& b, String& c);
-    bool _recvJobTriplet(String& seed40, String& target40, uint16_t& diff);
-    bool _handleSubmitJobResponse();
+    bool _send(const char *data, size_t len);
+    // Next buffered line into _line, false if none has arrived yet
+    bool _nextLine();
+    // Awaitables, read what's arrived first
+    bool _lineReady();
+    bool _bytesReady();
+    bool _recvJobTriplet();
+    bool _handleSubmitJobResponse(const char *resp);
+    // Drop the connection and node, the next connect picks a node again
+    void _failover(const char *reason);
+    void _releaseNode();
+    void _connectFailed();
+    // Request templates, rebuilt when the identity they carry changes
+    void _buildJobLine();
+    void _buildSubmitTail();
+    size_t _formatSubmit(char *out, size_t outSize, uint32_t foundNonce, uint32_t elapsedTimeUS, const char *workerId);
 
     void _checkMiningKey(String new_mining_key, String ducouser);
+    static void _onMiningKeyStatus(int status, const String& response, void *user);
 
     // ---- Emit helpers (now broadcast to all listeners) ----
     inline void _emit(PoolEvent ev, const PoolEventData& d) {
@@ -0,0 +1,100 @@
+#pragma once
+#ifndef _POOL_DISCOVERY_H
+#define _POOL_DISCOVERY_H
+
+#include "config.h"
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+struct POOL_ENDPOINT {
+  char name[32];
+  char host[48];
+  uint16_t port;
+};
+
+// What we've seen of one pool node. RTTs and the error rate are moving
+// averages so one slow reply doesn't move a worker
+struct POOL_NODE_STATS {
+  POOL_ENDPOINT ep;
+  uint16_t connectRttMs;      // TCP connect to pool version reply
+  uint16_t jobRttMs;          // JOB request to job received
+  float errorRate;            // 0..1, failed connects and job timeouts
+  uint8_t activeConns;
+  uint32_t connects;
+  uint32_t failures;
+  uint32_t sharesGood;
+  uint32_t sharesBad;
+  uint32_t downUntilMs;       // kept out of rotation until then, 0 if healthy
+};
+
+// Pool nodes shared by every Pool instance.
+//
+// Every getPool answer is added to a small list of candidate nodes, the
+// last ones are saved to NVS so a reboot can connect straight away. The
+// HTTPS request itself only ever runs in a background task, callers just
+// read the list. A failed lookup isn't retried for POOL_DISCOVERY_RETRY_MS.
+//
+// Pools report connect and JOB round trips and failures back, pick()
+// spreads new connections over the healthy nodes weighted by latency and
+// shouldLeave() tells a connected pool its node has gone bad.
+class PoolDiscovery {
+  public:
+    static PoolDiscovery& instance();
+
+    /// Load the saved nodes and start the refresh task. Once, from setup()
+    /// before any task uses it
+    void begin();
+
+    /// Best node for a new connection, -1 if none is known yet (a lookup is
+    /// on its way). Counts as a connection to it until unuse()
+    int8_t pick(POOL_ENDPOINT &out);
+    void unuse(int8_t node);
+
+    // ---- Reports from the pools ----
+    void reportConnect(int8_t node, uint32_t rttMs);
+    void reportJobRtt(int8_t node, uint32_t rttMs);
+    void reportShare(int8_t node, bool good);
+    /// Connect failed or the node stopped answering
+    void reportFailure(int8_t node);
+    /// The node is unhealthy and a better one is available
+    bool shouldLeave(int8_t node);
+
+    void requestRefresh();
+
+    // ---- Stats ----
+    uint32_t getFetchCount() const { return _fetchCount; }
+    uint32_t getFailCount() const { return _failCount; }
+    uint32_t getAgeMs() const { return _numNodes ? millis() - _fetchedMs : 0; }
+    uint8_t getNodeCount() const { return _numNodes; }
+    /// Snapshot of a node's stats, false if out of range
+    bool getNode(uint8_t node, POOL_NODE_STATS &out);
+
+  private:
+    PoolDiscovery() {}
+
+    POOL_NODE_STATS _nodes[POOL_MAX_NODES] = {};
+    uint8_t _numNodes = 0;
+    bool _fromNvs = false;          // loaded at boot, not yet confirmed by the server
+    bool _refreshWanted = false;
+    uint32_t _fetchedMs = 0;
+    uint32_t _lastAttemptMs = 0;
+    uint32_t _fetchCount = 0;
+    uint32_t _failCount = 0;
+
+    SemaphoreHandle_t _lock = nullptr;
+    TaskHandle_t _task = nullptr;
+
+    static void _taskMain(void *arg);
+    bool _due();
+    bool _fetch(POOL_ENDPOINT &ep);
+    bool _merge(const POOL_ENDPOINT &ep);
+    bool _isHealthy(const POOL_NODE_STATS &n, uint32_t now) const;
+    uint32_t _cost(const POOL_NODE_STATS &n) const;
+    void _recordError(POOL_NODE_STATS &n, bool failed);
+    void _load();
+    void _save();
+};
+
+#endif
@@ -0,0 +1,96 @@
+#pragma once
+#ifndef _POOL_MANAGER_H
+#define _POOL_MANAGER_H
+
+#include "config.h"
+#include "pool.h"
+#include <Arduino.h>
+
+#define POOL_MINER_NAME_LEN 20
+
+// Runs many workers over a smaller number of pool connections.
+//
+// The pool keeps one outstanding job per socket: after a JOB it expects the
+// result for that job before anything else. So a connection can't carry two
+// workers' exchanges interleaved, instead a worker leases a connection from
+// its JOB request until the share verdict, and everyone else mapped to that
+// connection queues behind it in order. Pool events are routed to whichever
+// worker holds the lease.
+class PoolManager {
+  public:
+    PoolManager(const String &username, const String &miningKey);
+
+    /// Create the connections, at most one per worker
+    void begin(uint8_t numWorkers, uint8_t maxConnections = POOL_MAX_CONNECTIONS);
+    void loop();
+
+    /// Connections are only kept up while mining
+    void setMining(bool flag);
+    void disconnectAll();
+
+    /// Name and type used for the worker's jobs and shares, and where its
+    /// pool events go
+    void setWorker(uint8_t worker, const String &minerName, DeviceType type, PoolEventCallback cb, void *user);
+
+    /// Queue for the worker's connection. Returns it once the worker is at
+    /// the front, nullptr while waiting
+    Pool* acquire(uint8_t worker);
+    /// Hand the connection to the next worker in the queue
+    void release(uint8_t worker);
+    /// Anyone queued behind the worker on its connection
+    bool hasWaiters(uint8_t worker) const;
+
+    /// The connection a worker maps to, whether it holds it or not
+    Pool* getPool(uint8_t worker);
+
+    // ---- Stats ----
+    uint8_t getConnectionCount() const { return _numConns; }
+    uint8_t getConnectionOf(uint8_t worker) const { return _workers[worker].conn; }
+    uint8_t getQueueDepth(uint8_t conn) const { return _conns[conn].queueLen; }
+    uint32_t getLeaseCount(uint8_t conn) const { return _conns[conn].leases; }
+    /// The worker holding the connection, -1 if nobody does
+    int16_t getOwner(uint8_t conn) const { return _conns[conn].queueLen ? _conns[conn].head : -1; }
+    /// RAM each worker adds here
+    static constexpr size_t workerBytes() { return sizeof(_Worker); }
+
+  private:
+    String _username;
+    String _miningKey;
+    bool _isMining = false;
+
+    static constexpr uint8_t _NONE = 0xFF;
+
+    // FIFO of workers linked through _Worker::next, the head holds the lease
+    struct _Conn {
+      PoolManager* mgr = nullptr;
+      Pool* pool = nullptr;
+      uint32_t leases = 0;
+      uint8_t head = _NONE;
+      uint8_t tail = _NONE;
+      uint8_t queueLen = 0;
+    };
+
+    struct _Worker {
+      PoolEventCallback cb = nullptr;
+      void* user = nullptr;
+      char minerName[POOL_MINER_NAME_LEN] = "";
+      uint8_t conn = 0;
+      uint8_t next = _NONE;         // behind it in its connection's queue
+      DeviceType type = DEVICE_AVR;
+      bool queued = false;
+    };
+
+    // Sized in begin()
+    _Conn* _conns = nullptr;
+    uint8_t _numConns = 0;
+    _Worker* _workers = nullptr;
+    uint8_t _numWorkers = 0;
+
+    void _grant(uint8_t conn);
+    void _unlink(_Conn &conn, uint8_t worker);
+
+    // Forwards a connection's events to its current lease holder
+    static void _eventSink(PoolEvent ev, const PoolEventData& d, void *user);
+};
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+#ifndef _SHARE_PACER_H
+#define _SHARE_PACER_H
+
+#include <Arduino.h>
+
+#define PACER_BUCKETS       7       // job to submit times 0, 250ms, 500ms ... 8s+
+#define PACER_MAX_HOLD_MS   8000UL
+
+// Learns how fast a worker can turn a job round before the pool (kolka)
+// starts rejecting its shares, and holds shares back to the job age that
+// gets the most accepted shares per minute.
+//
+// Keeps an acceptance rate per job age bucket from the verdicts. A share
+// is held until the start of the bucket with the best acceptance per
+// unit of time. Buckets below the hold slowly forget their rejections, so
+// the hold creeps back down once the pool stops objecting.
+class SharePacer {
+  public:
+    SharePacer();
+
+    /// How long after the job arrived its share may go out
+    uint32_t holdMs() const { return _holdMs; }
+    /// A share went out this long after its job arrived
+    void onSubmit(uint32_t jobAgeMs);
+    /// The pool's answer for the last submitted share
+    void onVerdict(bool accepted);
+
+    float getAcceptRate(uint8_t bucket) const { return bucket < PACER_BUCKETS ? _accept[bucket] : 0; }
+
+  private:
+    float _accept[PACER_BUCKETS];
+    uint32_t _holdMs = 0;
+    uint32_t _lastAgeMs = 0;
+    bool _awaitingVerdict = false;
+
+    static uint8_t _bucket(uint32_t ms);
+    void _choose();
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <Arduino.h>
+#include <atomic>
+#include <string.h>
+
+// Lock free byte ring for exactly one producer and one consumer, e.g. a
+// network callback task filling it and the main loop draining it. One
+// slot is kept empty to tell full from empty.
+template <size_t capacity>
+class SpscRing {
+
+public:
+  SpscRing() { clear(); }
+
+  /// Only safe while neither side is running
+  void clear() {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+  }
+
+  /// Producer. Copies as much as fits, returns the bytes taken
+  size_t push(const uint8_t *data, size_t len) {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    const size_t h = head.load(std::memory_order_acquire);
+    const size_t free = (h + capacity - t - 1) % capacity;
+    if (len > free) len = free;
+
+    const size_t first = (len < capacity - t) ? len : capacity - t;
+    memcpy(buffer + t, data, first);
+    memcpy(buffer, data + first, len - first);
+    tail.store((t + len) % capacity, std::memory_order_release);
+    return len;
+  }
+
+  /// Consumer. Returns the bytes copied out
+  size_t pop(uint8_t *out, size_t len) {
+    const size_t h = head.load(std::memory_order_relaxed);
+    const size_t t = tail.load(std::memory_order_acquire);
+    const size_t used = (t + capacity - h) % capacity;
+    if (len > used) len = used;
+
+    const size_t first = (len < capacity - h) ? len : capacity - h;
+    memcpy(out, buffer + h, first);
+    memcpy(out + first, buffer, len - first);
+    head.store((h + len) % capacity, std::memory_order_release);
+    return len;
+  }
+
+  size_t size() const {
+    const size_t h = head.load(std::memory_order_acquire);
+    const size_t t = tail.load(std::memory_order_acquire);
+    return (t + capacity - h) % capacity;
+  }
+
+protected:
+  uint8_t buffer[capacity];
+  std::atomic<size_t> head;     // next to read, consumer owned
+  std::atomic<size_t> tail;     // next to write, producer owned
+};
+
+#endif // _SPSC_RING_H_
@@ -0,0 +1,86 @@
+#ifndef _TASK_RUNNER_H_
+#define _TASK_RUNNER_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(ESP_PLATFORM)
+  #include <freertos/FreeRTOS.h>
+  #include <freertos/task.h>
+#else
+  #include <condition_variable>
+  #include <mutex>
+  #include <thread>
+#endif
+
+#define TASK_RUNNER_MAX 6
+
+// One subsystem on its own task. step() runs and returns how long it can
+// wait before its next deadline, the task then sleeps that long, at most
+// periodMs, or until notify(). So a subsystem with nothing to do costs
+// nothing and one with news doesn't wait out the period. Pinned to a core on the ESP32, a std::thread on the host.
+//
+// Each runner keeps its step count, the time spent in step() and, on the
+// ESP32, its stack high-water mark for the report.
+class TaskRunner {
+  public:
+    /// Returns the ms until it next needs to run, 0 for as soon as possible
+    typedef uint32_t (*StepFn)(void *arg);
+
+    /// core -1 lets the scheduler pick. periodMs is at least one tick
+    TaskRunner(const char *name, StepFn step, void *arg, uint32_t periodMs,
+               uint32_t stackBytes, uint8_t priority, int8_t core = -1);
+
+    bool start();
+    /// Wake the task before its period is up, from any task
+    void notify();
+    /// Expect no heap allocations from it once steady, see HeapStats.
+    /// Before start()
+    void setHeapStrict(bool strict) { _heapStrict = strict; }
+
+    const char* getName() const { return _name; }
+    int8_t getCore() const { return _core; }
+    uint32_t getSteps() const { return _steps.load(std::memory_order_relaxed); }
+    /// Least free stack seen in bytes, 0 where it can't be measured
+    uint32_t getStackHighWater() const;
+
+    // ---- Report over every started runner ----
+    static uint8_t getCount() { return _count; }
+    static TaskRunner* get(uint8_t i) { return i < _count ? _all[i] : nullptr; }
+    /// One report line, the CPU share is since the last call for this task
+    size_t formatReport(char *buf, size_t size);
+
+  private:
+    const char* _name;
+    StepFn _step;
+    void* _arg;
+    uint32_t _periodMs;
+    uint32_t _stackBytes;
+    uint8_t _priority;
+    int8_t _core;
+    bool _heapStrict = false;
+
+    std::atomic<uint32_t> _steps{0};
+    std::atomic<uint32_t> _busyUs{0};   // wraps, only differences are used
+    uint32_t _reportAtUs = 0;
+    uint32_t _reportBusyUs = 0;
+
+#if defined(ESP_PLATFORM)
+    TaskHandle_t _handle = nullptr;
+#else
+    std::thread* _thread = nullptr;
+    std::mutex _wakeLock;
+    std::condition_variable _wake;
+    bool _notified = false;
+#endif
+
+    static TaskRunner* _all[TASK_RUNNER_MAX];
+    static uint8_t _count;
+
+    static uint32_t _nowUs();
+    static void _taskMain(void *arg);
+    void _wait(uint32_t ms);
+};
+
+#endif // _TASK_RUNNER_H_
@@ -5,5 +5,6 @@
 
 const char * getChipId();
 uint8_t* hexStringToUint8Array(const String &hexString, uint8_t *uint8Array, const uint32_t arrayLength);
+uint8_t* hexStringToUint8Array(const char *hexChars, uint8_t *uint8Array, const uint32_t arrayLength);
 
 #endif  // _UTILS_H
@@ -1,28 +1,82 @@
 #ifndef WIREWRAP_H
 #define WIREWRAP_H
 #include <Arduino.h>
+#include "job.h"
+
+class I2CMaster;
 
 // Avoid naming this header/file "Wire.h/cpp" to not clash with Arduino core.
-void wirewrap_setup();
-void wirewrap_loop();
 
-void wire_start();
+// Driver for stock Duino-Coin I2C slaves, which speak the original text
+// protocol: the job goes over as "lastblockhash,newblockhash,difficulty\n"
+// one character per transaction, and the result comes back one byte per
+// read as "nonce,elapsed_us,DUCOID...\n" (a bare '\n' while still busy).
+//
+// Nothing here blocks. Each poll() does at most one bus transaction and is
+// paced per slave, so any number of these can share the loop with the
+// native protocol slaves.
+class WireWrapSlave {
+public:
+    enum WW_STATE : uint8_t {
+        WW_IDLE,
+        WW_SENDING,       // job line going out a char at a time
+        WW_WAITING,       // slave is hashing
+        WW_READING,       // result line coming back
+        WW_DONE,          // result ready, see getResult()
+        WW_ERROR
+    };
+
+    WireWrapSlave(I2CMaster *i2c, uint8_t address);
+
+    /// Flush anything left in the slave's buffers. Blocks, only for setup
+    void begin();
+
+    /// Queue a job. Fails if a job is already in flight
+    bool startJob(const Job &job);
+
+    /// Advance the transfer, at most one bus transaction per call
+    WW_STATE poll();
+
+    /// Result of the last job, valid in WW_DONE. Goes back to WW_IDLE
+    bool getResult(uint32_t &nonce, uint32_t &elapsedUs);
+
+    /// Forget the current job. A job the slave is still hashing will
+    /// produce a line later, which gets thrown away
+    void reset();
+
+    WW_STATE state() const { return _state; }
+
+    /// micros() when poll() next has something to do, the pacing of a
+    /// char going out or coming back, or the next result poll
+    uint32_t nextStepUs() const;
+
+private:
+    static constexpr uint16_t _charPacingUs = 500;    // per char when sending
+    static constexpr uint16_t _readPacingUs = 100;    // per char when reading
+    static constexpr uint16_t _resultPollMs = 40;     // while the slave hashes
+    static constexpr uint8_t  _maxErrors    = 8;
 
-void wire_read_all();
-void wire_send_all(String message);
+    I2CMaster *_i2c;
+    uint8_t _address;
+    WW_STATE _state = WW_IDLE;
 
-boolean wire_exists(byte address);
+    char _tx[40+1+40+1+5+1+1];      // seed,target,diff\n
+    uint8_t _txLen = 0;
+    uint8_t _txPos = 0;
 
-void wire_send_job(byte address, String lastblockhash, String newblockhash, int difficulty);
-void wire_sendln(byte address, String message);
-void wire_send_cmd(byte address, String message);
-void wire_send(byte address, String message);
+    char _rx[48];
+    uint8_t _rxLen = 0;
+    uint8_t _staleLines = 0;        // results of reset jobs still to come
+    uint8_t _errors = 0;
 
-String wire_readline(int address);
+    uint32_t _lastStepUs = 0;
+    uint32_t _lastPollMs = 0;
 
-boolean wire_run_every(unsigned long interval);
-boolean wire_run_every_micro(unsigned long interval);
+    uint32_t _nonce = 0;
+    uint32_t _elapsedUs = 0;
 
-void wire_scan();
+    bool _parseResult();
+    void _error();
+};
 
-#endif // WIREWRAP_H
\ No newline at end of file
+#endif // WIREWRAP_H
@@ -1,6 +1,10 @@
 #include "config.h"
 #include "utils.h"
 #include "I2CMaster.h"
+#include "i2c_bus_wire.h"
+#include "bootArena.h"
+
+#include <Preferences.h>
 
 //#define DEBUG_FULL 1
 
@@ -22,88 +26,210 @@ static inline uint8_t crc8_maxim(const uint8_t data, size_t len, uint8_t crc = 0
     return crc8_maxim(dataArray, len, crc);
 }
 
+static void idToHex(const uint8_t id[8], char out[(8*2)+1]) {
+    for(int x=0;x<8;x++) {
+        byte b1=id[x] >> 4;
+        byte b2=id[x] & 0x0f;
+        b1+='0'; if (b1>'9') b1 += 7;  // gap between '9' and 'A'
+        b2+='0'; if (b2>'9') b2 += 7;
+        out[x*2] = b1;
+        out[(x*2)+1] = b2;
+    }
+    out[(8*2)] = 0;
+}
+
 I2CMaster::I2CMaster(int sdaPin, int sclPin, uint32_t freq, bool doBegin)
-    : _sdaPin(sdaPin), _sclPin(sclPin), _freq(freq) {
+    : _bus(new I2CBusWire(sdaPin, sclPin, freq)) {
         begin();
     }
 
-void I2CMaster::begin() {
-    DEBUGPRINT("[I2C] Starting wire with pins. SDA: ");
-    DEBUGPRINT(_sdaPin);
-    DEBUGPRINT(" SCL: ");
-    DEBUGPRINT(_sclPin);
-    DEBUGPRINT(" Freq: ");
-    DEBUGPRINT(_freq);
-    DEBUGPRINT_LN();
+I2CMaster::I2CMaster(I2CBus *bus, bool doBegin)
+    : _bus(bus) {
+        if (doBegin) begin();
+    }
 
-    Wire.begin(_sdaPin, _sclPin, _freq);
-    delay(50);
-    Wire.setTimeOut(300);
+void I2CMaster::begin() {
+    _bus->begin();
+    _bus->setTimeout(_timeout);
 }
 
 void I2CMaster::setTimeout(uint16_t timeout) {
     _timeout = timeout;
-    Wire.setTimeOut(timeout);
+    _bus->setTimeout(timeout);
 }
 
 bool I2CMaster::probe(uint8_t address) {
     for (int attempt = 0; attempt < _retries; ++attempt) {
-        Wire.beginTransmission(address);
-        uint8_t err = Wire.endTransmission();
-        if (err == 0) return true;
+        uint8_t err = _bus->write(address, nullptr, 0);
+        if (err == 0) {
+            _busOk();
+            return true;
+        }
+        // A NACK just means nobody is home, only timeouts point at the bus
+        if (err == 4 || err == 5) _busTimeout(address);
         delay(_scanDelayMs);
     }
     return false;
 }
 
+bool I2CMaster::writeByte(uint8_t address, uint8_t b) {
+    uint8_t err = _bus->write(address, &b, 1);
+    if (err == 0) {
+        _busOk();
+        return true;
+    }
+    if (err == 4 || err == 5) _busTimeout(address);
+    return false;
+}
+
+bool I2CMaster::readByte(uint8_t address, uint8_t &b) {
+    uint8_t err = _bus->read(address, &b, 1);
+    if (err != 0) {
+        if (err == 4 || err == 5) _busTimeout(address);
+        return false;
+    }
+    _busOk();
+    return true;
+}
+
 uint8_t I2CMaster::getFoundSlaveCount() {
     return _slaveCount;
 }
 
 I2CMaster::I2C_SLAVE* I2CMaster::getFoundSlave(uint8_t idx) {
-    return (idx > _slaveCount) ? 0 : &_slaves[idx];    
+    return (idx >= _slaveCount) ? 0 : &_slaves[idx];
 }
 
 uint8_t I2CMaster::getFoundSlaveAddress(uint8_t idx) {
-    return (idx > _slaveCount) ? 0 : _slaves[idx].address;
+    return (idx >= _slaveCount) ? 0 : _slaves[idx].address;
 }
 
 void I2CMaster::scan(bool getIds) {
     _slaveCount = 0;
-    memset(_slaves, 0, sizeof(_slaves));
 
-    bool found = false;
+    // Move any fresh slaves off the shared address first so the sweep finds them
+    if (probe(I2C_DEFAULT_SLAVE_ADDR)) {
+        enumerate();
+    }
+
+    // Sweep first, the table is sized for what answered
+    uint32_t answered[4] = {};
+    uint8_t count = 0;
     for (uint8_t addr = 1; addr < 127; ++addr) {
+        // Anything left on the default address failed enumeration, and there
+        // may be several of them answering at once
+        if (addr == I2C_DEFAULT_SLAVE_ADDR) continue;
+        if (count >= MAX_I2C_WORKERS) break;
         if (probe(addr)) {
+            answered[addr >> 5] |= 1UL << (addr & 31);
+            count++;
+        }
+    }
+
+    _allocSlaves(count);
+    memset(_slaves, 0, sizeof(I2C_SLAVE) * _slavesAllocated);
+    for (uint8_t addr = 1; addr < 127; ++addr) {
+        if (answered[addr >> 5] & (1UL << (addr & 31))) {
             _slaves[_slaveCount++].address = addr;
-            found = true;
         }
     }
+    const bool found = (_slaveCount > 0);
 
     // Do this in it's own loop so slaves get saved
     if(getIds) {
         for(int i=0; i < _slaveCount; i++) {
             uint8_t resp[8];
-            if(!_sendCmd(_slaves[i].address, CMD_GET_UNIQUEID))
+            if(!_command(_slaves[i].address, CMD_GET_UNIQUEID, resp, 8))
                 continue;
-            if(!_getResponse(_slaves[i].address, 8, resp))
+
+            // A stock slave doesn't know the command and answers the read
+            // with its idle '\n', the rest of the bytes are bus padding
+            bool legacy = (resp[0] == '\n');
+            for(int x=1; x<8 && legacy; x++) legacy = (resp[x] == 0xFF);
+            if(legacy) {
+                _slaves[i].protocol = I2C_PROTO_LEGACY;
+                strcpy(_slaves[i].slaveUniqueID, "LEGACY");
                 continue;
-            DEBUGPRINT("Unique ID: ");
-            for(int x=0;x<8;x++) {
-                byte b1=resp[x] >> 4;
-                byte b2=resp[x] & 0x0f;
-                b1+='0'; if (b1>'9') b1 += 7;  // gap between '9' and 'A'
-                b2+='0'; if (b2>'9') b2 += 7;
-                _slaves[i].slaveUniqueID[x*2] = b1;
-                _slaves[i].slaveUniqueID[(x*2)+1] = b2;
             }
-            _slaves[i].slaveUniqueID[(8*2)] = 0;
+
+            idToHex(resp, _slaves[i].slaveUniqueID);
+            DEBUGPRINT("Unique ID: ");
+            DEBUGPRINT_LN(_slaves[i].slaveUniqueID);
         }
     }
 
     if (!found) DEBUGPRINT_LN("[I2C] Scan - no devices found.");
 }
 
+/// @brief Enumeration protocol. Every slave on the default address answers
+/// CMD_ENUM_GET_ID with its unique ID and a CRC. If more than one answers
+/// the IDs get AND'ed on the wire and the CRC fails, in which case they are
+/// told to back off for a random time and we try again. A slave that sees
+/// its own ID in CMD_SET_ADDRESS moves to the new address straight away.
+uint8_t I2CMaster::enumerate() {
+    _loadAddressMap();
+
+    uint8_t assigned = 0;
+    uint16_t attempts = 0;
+    uint32_t quietUntil = 0;
+
+    while (attempts++ < _enumMaxAttempts) {
+        if (!probe(I2C_DEFAULT_SLAVE_ADDR)) {
+            // Slaves told to back off don't ACK until their timer runs out
+            if ((int32_t)(quietUntil - millis()) > 0) {
+                delay(_scanDelayMs);
+                continue;
+            }
+            break;      // nobody left on the default address
+        }
+
+        uint8_t resp[9];
+        if (!_command(I2C_DEFAULT_SLAVE_ADDR, CMD_ENUM_GET_ID, resp, 9)) {
+            continue;
+        }
+
+        if (crc8_maxim(resp, 8) != resp[8]) {
+            DEBUGPRINT_LN("[I2C] Enumerate - ID collision, backing off");
+            _sendCmd(I2C_DEFAULT_SLAVE_ADDR, CMD_ENUM_BACKOFF);
+            quietUntil = millis() + _enumBackoffMs;
+            delay(_scanDelayMs);
+            continue;
+        }
+
+        // Same device gets the same address as last boot, unless it's taken
+        uint8_t addr = _lookupAddress(resp);
+        if (addr == 0 || probe(addr)) {
+            addr = _findFreeAddress(resp);
+        }
+        if (addr == 0) {
+            SERIALPRINT_LN("[I2C] Enumerate - no free address left");
+            break;
+        }
+
+        if (_assignAddress(resp, addr)) {
+            assigned++;
+        }
+    }
+
+    if (assigned > 0) {
+        _saveAddressMap();
+        SERIALPRINT("[I2C] Enumerate - assigned ");
+        SERIALPRINT(assigned);
+        SERIALPRINT_LN(" slave address(es)");
+    }
+    return assigned;
+}
+
+void I2CMaster::clearAddressMap() {
+    Preferences prefs;
+    if (prefs.begin(_addrMapNamespace, false)) {
+        prefs.clear();
+        prefs.end();
+    }
+    _addrMapCount = 0;
+    _addrMapLoaded = true;
+}
+
 void I2CMaster::dumpSlaves() {
     SERIALPRINT_LN("I2C device list:");
     for(int i=0; i < _slaveCount; i++) {
@@ -111,29 +237,22 @@ void I2CMaster::dumpSlaves() {
         SERIALPRINT_HEX(_slaves[i].address);
         SERIALPRINT(" uniq id: ");
         SERIALPRINT(_slaves[i].slaveUniqueID);
+        if(_slaves[i].protocol == I2C_PROTO_LEGACY) SERIALPRINT(" (stock firmware)");
         SERIALPRINT_LN();
     }
 }
 
 bool I2CMaster::version(uint8_t address, uint8_t &ver_major, uint8_t &ver_minor) {
-    if(!_sendCmd(address, CMD_VERSION)) return false;
-
-    uint32_t start = millis();
-    while (millis() - start < _timeout) {
-        if (Wire.requestFrom((int)address, 1) == 1) {
-            ver_major = (uint8_t)Wire.read();
-            ver_minor = (uint8_t)Wire.read();
-        }
-        delay(5);
-    }
-    return false;
+    uint8_t resp[2];
+    if(!_command(address, CMD_VERSION, resp, 2)) return false;
+    ver_major = resp[0];
+    ver_minor = resp[1];
+    return true;
 }
 
 bool I2CMaster::queryUptime(uint8_t address, uint32_t &outMillis) {
-    if(!_sendCmd(address, CMD_GET_UPTIME)) return false;
-
     uint8_t res[4];
-    if(_getResponse(address, 4, res)) {
+    if(_command(address, CMD_GET_UPTIME, res, 4)) {
         uint32_t v = 0;
         v |= (uint32_t)res[0];
         v |= (uint32_t)res[1] << 8;
@@ -147,16 +266,12 @@ bool I2CMaster::queryUptime(uint8_t address, uint32_t &outMillis) {
 }
 
 bool I2CMaster::queryUniqueId(uint8_t address, uint8_t id[8]) {
-    if(!_sendCmd(address, CMD_GET_UNIQUEID)) return false;
-
-    return _getResponse(address, 8, id);
+    return _command(address, CMD_GET_UNIQUEID, id, 8);
 }
 
 bool I2CMaster::sendDataBegin(uint8_t address) {
-    if(!_sendCmd(address, CMD_BEGIN_DATA)) return false;
-
     uint8_t data[1];
-    if ( ! _getResponse(address, 1, data) ) {
+    if ( ! _command(address, CMD_BEGIN_DATA, data, 1) ) {
         return false;
     }
 
@@ -186,20 +301,9 @@ bool I2CMaster::sendData(uint8_t address, const uint8_t *data, const uint8_t len
     while(i < len) {
         dataBuf[0] = i + startSeq;         // sequence
         dataBuf[1] = data[i];   // actual data
-        if (!_sendCmd(address, CMD_SEND_DATA, dataBuf, 2)) {
-            if(sendRespRetry++ < 3) {
-                continue;       // try again
-            }
-            else {
-                return false;
-            }
-        }
-        sendRespRetry = 0;
-
         uint8_t respBuf[3];
-        if(!_getResponse(address, 3, respBuf)) {
-            DEBUGPRINT_LN(respBuf[1]);
-            if(sendRespRetry++ < 2) {
+        if (!_command(address, CMD_SEND_DATA, dataBuf, 2, respBuf, 3)) {
+            if(sendRespRetry++ < 3) {
                 continue;       // try again
             }
             else {
@@ -230,9 +334,36 @@ bool I2CMaster::sendData(uint8_t address, const uint8_t *data, const uint8_t len
 }
 
 /// @brief Send the job data to the slave
-bool I2CMaster::sendJobData(uint8_t address, const char *previousHashStr,
-    const char *expectedHashStr, uint8_t difficulty) {
+bool I2CMaster::sendJobData(uint8_t address, const Job &job, uint8_t difficulty) {
+
+    // ----------------------------------
+    // Make a packet array to send
+    // ----------------------------------
+    uint8_t job_packet[JOB_FRAME_LEN];
+    memcpy(job_packet, job.seedHex, 41);        // null ending prev hash string
+    memcpy(&job_packet[41], job.target, 20);    // already decoded by the pool
+    job_packet[41+20] = difficulty;
+
+    return _sendJobFrame(address, job_packet, JOB_FRAME_LEN);
+}
+
+/// @brief Send a job the slave only searches part of
+bool I2CMaster::sendJobData(uint8_t address, const Job &job, uint8_t difficulty,
+    uint32_t rangeStart, uint32_t rangeEnd) {
+
+    uint8_t job_packet[JOB_RANGE_FRAME_LEN];
+    memcpy(job_packet, job.seedHex, 41);
+    memcpy(&job_packet[41], job.target, 20);
+    job_packet[41+20] = difficulty;
+    for (uint8_t b = 0; b < 4; b++) {
+        job_packet[JOB_FRAME_LEN + b]     = (uint8_t)(rangeStart >> (8 * b));
+        job_packet[JOB_FRAME_LEN + 4 + b] = (uint8_t)(rangeEnd >> (8 * b));
+    }
 
+    return _sendJobFrame(address, job_packet, JOB_RANGE_FRAME_LEN);
+}
+
+bool I2CMaster::_sendJobFrame(uint8_t address, const uint8_t *frame, uint8_t len) {
     if(!sendDataBegin(address)) {
         SERIALPRINT_LN("[I2C] error from send data begin check.");
         return false;
@@ -244,21 +375,12 @@ bool I2CMaster::sendJobData(uint8_t address, const char *previousHashStr,
 
     uint8_t resp[4];    // max response size
 
-    // ----------------------------------
-    // Make a packet array to send
-    // ----------------------------------
-    uint8_t job_packet[41+20+1];
-    memcpy(job_packet, previousHashStr, 41);    // null ending prev hash string
-    hexStringToUint8Array(expectedHashStr, &job_packet[41] ,20);  // convert to byte array directly into the packet
-    job_packet[41+20] = difficulty;
-    if( !sendData(address, job_packet, 41+20+1) ) return false;
+    if( !sendData(address, frame, len) ) return false;
 
-    u_int8_t crc8[1] = { crc8_maxim(job_packet, 41+20+1) };
+    u_int8_t crc8[1] = { crc8_maxim(frame, len) };
 
     delay(2); // Give slave a chance to load data and process a CRC on device
-    if( !_sendCmd(address, CMD_END_DATA, crc8, 1) ) return false;
-    
-    if(!_getResponse(address, 1, resp)) return false;
+    if( !_command(address, CMD_END_DATA, crc8, 1, resp, 1) ) return false;
     if( resp[0] == 0xAA) {
         return true;
     }
@@ -272,10 +394,8 @@ bool I2CMaster::sendJobData(uint8_t address, const char *previousHashStr,
 }
 
 bool I2CMaster::getJobStatus(uint8_t address) {
-    if( !_sendCmd(address, CMD_GET_JOB_STATUS) ) return false;
-
     uint8_t resp[4];
-    if(!_getResponse(address, 1, resp)) return false;
+    if(!_command(address, CMD_GET_JOB_STATUS, resp, 1)) return false;
     return ( resp[0] == 0xAA);
 }
 
@@ -284,10 +404,8 @@ bool I2CMaster::getJobResult(uint8_t address, uint16_t &foundNonce, uint16_t &ti
         return false;
     }
 
-    if( !_sendCmd(address, CMD_GET_JOB_RESULT) ) return false;
-
     uint8_t resp[5];
-    if(!_getResponse(address, 5, resp)) return false;
+    if(!_command(address, CMD_GET_JOB_RESULT, resp, 5)) return false;
     if( resp[0] == 0xAA) {
         foundNonce   = (uint16_t)resp[1];
         foundNonce  |= (uint16_t)resp[2] << 8;
@@ -304,13 +422,196 @@ bool I2CMaster::getJobResult(uint8_t address, uint16_t &foundNonce, uint16_t &ti
     return false;
 }
 
+bool I2CMaster::getJobResultRange(uint8_t address, uint32_t &foundNonce, uint16_t &timeTakenMs) {
+    if( !getJobStatus(address) ) {
+        return false;
+    }
+
+    uint8_t resp[7];
+    if(!_command(address, CMD_GET_JOB_RESULT32, resp, 7)) return false;
+    if( resp[0] == 0xAA) {
+        foundNonce   = (uint32_t)resp[1];
+        foundNonce  |= (uint32_t)resp[2] << 8;
+        foundNonce  |= (uint32_t)resp[3] << 16;
+        foundNonce  |= (uint32_t)resp[4] << 24;
+        timeTakenMs  = (uint16_t)resp[5];
+        timeTakenMs |= (uint16_t)resp[6] << 8;
+        return true;
+    }
+
+    return false;
+}
+
+bool I2CMaster::getJobProgress(uint8_t address, uint32_t &currentNonce, uint32_t &elapsedMs, bool &done) {
+    // status: 0xAA result ready, 0x55 still searching, anything else no job
+    uint8_t resp[9];
+    if(!_command(address, CMD_GET_JOB_PROGRESS, resp, 9)) return false;
+    if(resp[0] != 0xAA && resp[0] != 0x55) return false;
+
+    done = (resp[0] == 0xAA);
+    currentNonce  = (uint32_t)resp[1];
+    currentNonce |= (uint32_t)resp[2] << 8;
+    currentNonce |= (uint32_t)resp[3] << 16;
+    currentNonce |= (uint32_t)resp[4] << 24;
+    elapsedMs     = (uint32_t)resp[5];
+    elapsedMs    |= (uint32_t)resp[6] << 8;
+    elapsedMs    |= (uint32_t)resp[7] << 16;
+    elapsedMs    |= (uint32_t)resp[8] << 24;
+    return true;
+}
+
+bool I2CMaster::abortJob(uint8_t address) {
+    uint8_t resp[1];
+    if(!_command(address, CMD_ABORT_JOB, resp, 1)) return false;
+
+    DEBUGPRINT("[I2C] abortJob 0x");
+    DEBUGPRINT_HEX(address);
+    DEBUGPRINT(" Status: 0x");
+    DEBUGPRINT_HEX(resp[0]);
+    DEBUGPRINT_LN();
+
+    return ( resp[0] == 0xAA);
+}
+
 /**
  * ************** PRIVATES ***************
  */
+
+/// @brief Slave table for count slaves. Only ever grows, from the boot
+/// arena, so a rescan finding fewer keeps the one it has
+void I2CMaster::_allocSlaves(uint8_t count) {
+    if (count == 0) count = 1;
+    if (_slaves != nullptr && count <= _slavesAllocated) return;
+
+    _slaves = BootArena::instance().makeArray<I2C_SLAVE>(count);
+    _slavesAllocated = count;
+}
+
+/// @brief Room for count map entries, false past MAX_I2C_WORKERS. Doubles,
+/// the map only grows by one per new device
+bool I2CMaster::_growAddressMap(uint8_t count) {
+    if (count <= _addrMapSize) return true;
+    if (count > MAX_I2C_WORKERS) return false;
+
+    uint16_t size = _addrMapSize ? _addrMapSize * 2 : 8;
+    if (size < count) size = count;
+    if (size > MAX_I2C_WORKERS) size = MAX_I2C_WORKERS;
+
+    ADDR_MAP_ENTRY* map = BootArena::instance().makeArray<ADDR_MAP_ENTRY>(size);
+    if (_addrMapCount > 0) memcpy(map, _addrMap, sizeof(ADDR_MAP_ENTRY) * _addrMapCount);
+    _addrMap = map;
+    _addrMapSize = (uint8_t)size;
+    return true;
+}
+
+void I2CMaster::_loadAddressMap() {
+    if (_addrMapLoaded) return;
+    _addrMapLoaded = true;
+    _addrMapCount = 0;
+
+    Preferences prefs;
+    if (!prefs.begin(_addrMapNamespace, true)) return;
+    size_t len = prefs.getBytesLength("map");
+    if (len > 0 && (len % sizeof(ADDR_MAP_ENTRY)) == 0
+        && _growAddressMap(len / sizeof(ADDR_MAP_ENTRY))) {
+        prefs.getBytes("map", _addrMap, len);
+        _addrMapCount = len / sizeof(ADDR_MAP_ENTRY);
+    }
+    prefs.end();
+
+    DEBUGPRINT("[I2C] Loaded address map entries: ");
+    DEBUGPRINT_LN(_addrMapCount);
+}
+
+void I2CMaster::_saveAddressMap() {
+    Preferences prefs;
+    if (!prefs.begin(_addrMapNamespace, false)) {
+        SERIALPRINT_LN("[I2C] Can't open NVS to save address map");
+        return;
+    }
+    prefs.putBytes("map", _addrMap, _addrMapCount * sizeof(ADDR_MAP_ENTRY));
+    prefs.end();
+}
+
+uint8_t I2CMaster::_lookupAddress(const uint8_t id[8]) {
+    for (uint8_t i = 0; i < _addrMapCount; i++) {
+        if (memcmp(_addrMap[i].id, id, 8) == 0) return _addrMap[i].address;
+    }
+    return 0;
+}
+
+uint8_t I2CMaster::_findFreeAddress(const uint8_t id[8]) {
+    for (uint8_t addr = I2C_ASSIGN_ADDR_FIRST; addr <= I2C_ASSIGN_ADDR_LAST; addr++) {
+        if (addr == I2C_DEFAULT_SLAVE_ADDR) continue;
+
+        // Keep addresses reserved for devices we've seen before, even if
+        // they're powered off right now
+        bool reserved = false;
+        for (uint8_t i = 0; i < _addrMapCount; i++) {
+            if (_addrMap[i].address == addr && memcmp(_addrMap[i].id, id, 8) != 0) {
+                reserved = true;
+                break;
+            }
+        }
+        if (reserved) continue;
+        if (probe(addr)) continue;
+        return addr;
+    }
+    return 0;
+}
+
+bool I2CMaster::_assignAddress(const uint8_t id[8], uint8_t address) {
+    uint8_t data[8+1+1];
+    memcpy(data, id, 8);
+    data[8] = address;
+    data[9] = crc8_maxim(data, 9);
+    if (!_sendCmd(I2C_DEFAULT_SLAVE_ADDR, CMD_SET_ADDRESS, data, sizeof(data))) return false;
+
+    // Give the slave time to re-init its TWI peripheral, then make sure the
+    // right device turned up at the new address
+    delay(10);
+    uint8_t check[8];
+    if (!probe(address) || !queryUniqueId(address, check) || memcmp(check, id, 8) != 0) {
+        SERIALPRINT("[I2C] Enumerate - slave didn't move to 0x");
+        SERIALPRINT_HEX(address);
+        SERIALPRINT_LN();
+        return false;
+    }
+
+    // Update the map, reusing the device's own entry or one for a device
+    // that isn't on the bus any more when full
+    int8_t slot = -1;
+    for (uint8_t i = 0; i < _addrMapCount; i++) {
+        if (memcmp(_addrMap[i].id, id, 8) == 0) { slot = i; break; }
+    }
+    if (slot < 0 && _growAddressMap(_addrMapCount + 1)) {
+        slot = _addrMapCount++;
+    }
+    if (slot < 0) {
+        for (uint8_t i = 0; i < _addrMapCount; i++) {
+            if (!probe(_addrMap[i].address)) { slot = i; break; }
+        }
+    }
+    if (slot >= 0) {
+        memcpy(_addrMap[slot].id, id, 8);
+        _addrMap[slot].address = address;
+    }
+
+    char idHex[(8*2)+1];
+    idToHex(id, idHex);
+    SERIALPRINT("[I2C] Enumerate - ");
+    SERIALPRINT(idHex);
+    SERIALPRINT(" -> 0x");
+    SERIALPRINT_HEX(address);
+    SERIALPRINT_LN();
+    return true;
+}
+
 bool I2CMaster::_sendCmd(uint8_t address, const uint8_t cmd, const uint8_t data[], uint8_t len, bool sendStop) {
-    Wire.beginTransmission((uint16_t)address);
-    Wire.write(cmd);
-    if(len > 0) Wire.write(data, len);
+    uint8_t frame[_maxCmdLen];
+    if(len > _maxCmdLen - 1) return false;
+    frame[0] = cmd;
+    if(len > 0) memcpy(&frame[1], data, len);
     
     #if defined DEBUG_FULL
       DEBUGPRINT("[I2C] Sending cmd: 0x");
@@ -328,12 +629,7 @@ bool I2CMaster::_sendCmd(uint8_t address, const uint8_t cmd, const uint8_t data[
     #endif
 
 
-    // if(len > 0) {
-    //     for(uint8_t x = 0; x < len; x++) {
-    //         Wire.write(data[x]);
-    //     }
-    // }
-    int8_t ret = Wire.endTransmission(sendStop);
+    int8_t ret = _bus->write(address, frame, len + 1, sendStop);
     #if defined(DEBUG_PRINT)
         if(ret!=0) DEBUGPRINT(F("[I2C _sendCmd Error - ]"));
         switch (ret)
@@ -352,34 +648,103 @@ bool I2CMaster::_sendCmd(uint8_t address, const uint8_t cmd, const uint8_t data[
             break;
         }
     #endif
+    if (ret == 0) _busOk();
+    else if (ret == 4 || ret == 5) _busTimeout(address);
+
     return (ret != 0) ? false : true;
 }
 
-bool I2CMaster::_getResponse(uint8_t address, uint8_t respLength, uint8_t data[], bool sendStop) {
+/// @brief Send a command and read its answer back in one transfer, a
+/// repeated start rather than a STOP between the two. Tried again until the
+/// timeout, a slave busy with its last command may not have the answer yet
+bool I2CMaster::_command(uint8_t address, const uint8_t cmd, const uint8_t data[], uint8_t len, uint8_t resp[], uint8_t respLen) {
+    uint8_t frame[_maxCmdLen];
+    if(len > _maxCmdLen - 1) return false;
+    frame[0] = cmd;
+    if(len > 0) memcpy(&frame[1], data, len);
+
     uint32_t start = millis();
+    uint8_t err = 0;
     while (millis() - start < _timeout) {
-        if (Wire.requestFrom((uint16_t)address, (size_t)respLength, sendStop) == respLength) {
-            if (!Wire.available()) {
-                break; // unexpected; fall through to retry
-            }
-            
-            #if defined DEBUG_FULL
-                DEBUGPRINT("[I2C] Got response data: ");
-            #endif
-            for (uint8_t c = 0; c < respLength; c++) {
-                data[c] = Wire.read();
-                #if defined DEBUG_FULL
-                    DEBUGPRINT_HEX( data[c] );
-                #endif
-            }
+        err = _bus->writeRead(address, frame, len + 1, resp, respLen);
+        if (err == 0) {
             #if defined DEBUG_FULL
+                DEBUGPRINT("[I2C] Cmd 0x");
+                DEBUGPRINT_HEX(cmd);
+                DEBUGPRINT(" got response data: ");
+                for (uint8_t c = 0; c < respLen; c++) {
+                    DEBUGPRINT_HEX( resp[c] );
+                }
                 DEBUGPRINT_LN(" | END");
             #endif
-            
-            while(Wire.available()) Wire.read();    // flush
+            _busOk();
             return true;
         }
+        // Nobody home, or it'll never fit, no point asking again
+        if (err == 1 || err == 2) break;
         delay(2);
     }
+    #if defined(DEBUG_PRINT)
+        DEBUGPRINT(F("[I2C _command Error - ]"));
+        DEBUGPRINT_LN(err);
+    #endif
+    // Bus errors (4/5) count towards a recovery, a data NACK (3) is only a
+    // slave still busy with its last command
+    if (err == 4 || err == 5) _busTimeout(address);
     return false;
+}
+
+void I2CMaster::_busOk() {
+    if (_busFailCount == 0) return;
+    _busFailCount = 0;
+    _busFailAddrCount = 0;
+    memset(_busFailAddrs, 0, sizeof(_busFailAddrs));
+}
+
+void I2CMaster::_busTimeout(uint8_t address) {
+    address &= 0x7F;
+    uint32_t bit = 1UL << (address & 31);
+    if (!(_busFailAddrs[address >> 5] & bit)) {
+        _busFailAddrs[address >> 5] |= bit;
+        _busFailAddrCount++;
+    }
+    if (_busFailCount < 255) _busFailCount++;
+
+    if (_busFailCount < _busFailThreshold) return;
+
+    // With a small fleet we can't wait for failures on 3 different addresses,
+    // so a low SDA while idle is taken as proof on its own
+    uint8_t minAddrs = (_slaveCount > 0 && _slaveCount < _busFailMinAddrs) ? _slaveCount : _busFailMinAddrs;
+    if (_busFailAddrCount >= minAddrs || _bus->sdaStuckLow()) {
+        SERIALPRINT("[I2C] Bus appears stuck after ");
+        SERIALPRINT(_busFailCount);
+        SERIALPRINT_LN(" timeouts, recovering ...");
+        recoverBus();
+    }
+}
+
+/// @brief Free a bus a browned out slave is holding and start over
+bool I2CMaster::recoverBus() {
+    const uint32_t start = micros();
+
+    const bool released = _bus->recover();
+    _bus->setTimeout(_timeout);
+
+    const uint32_t took = micros() - start;
+    _busStats.recoveries++;
+    if (!released) _busStats.failedRecoveries++;
+    _busStats.lastRecoveryMs = millis();
+    _busStats.lastRecoveryUs = took;
+    _busStats.totalRecoveryUs += took;
+
+    SERIALPRINT("[I2C] Bus recovery ");
+    SERIALPRINT(released ? "done" : "failed, SDA still low");
+    SERIALPRINT(" in ");
+    SERIALPRINT(took);
+    SERIALPRINT_LN("us");
+
+    _busFailCount = 0;
+    _busFailAddrCount = 0;
+    memset(_busFailAddrs, 0, sizeof(_busFailAddrs));
+    return released;
 }
\ No newline at end of file
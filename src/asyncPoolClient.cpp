@@ -0,0 +1,98 @@
+#include "config.h"
+#include "asyncPoolClient.h"
+
+AsyncPoolClient::AsyncPoolClient()
+  : _client(new AsyncClient()), _state(ASYNC_IDLE), _overflow(0) {
+  _client->setNoDelay(true);      // lines are small and latency matters
+  _client->onConnect(&AsyncPoolClient::_onConnect, this);
+  _client->onDisconnect(&AsyncPoolClient::_onDisconnect, this);
+  _client->onError(&AsyncPoolClient::_onError, this);
+  _client->onData(&AsyncPoolClient::_onData, this);
+}
+
+AsyncPoolClient::~AsyncPoolClient() {
+  _client->close(true);
+  delete _client;
+}
+
+bool AsyncPoolClient::connect(const char *host, uint16_t port, uint32_t timeoutMs) {
+  stop();
+  _rx.clear();
+  _connectStartMs = millis();
+  _connectTimeoutMs = timeoutMs;
+  _owner = xTaskGetCurrentTaskHandle();
+  _state = ASYNC_CONNECTING;
+  if (!_client->connect(host, port)) {
+    _state = ASYNC_FAILED;
+    return false;
+  }
+  return true;
+}
+
+bool AsyncPoolClient::connected() {
+  return _state == ASYNC_CONNECTED;
+}
+
+bool AsyncPoolClient::connecting() {
+  if (_state != ASYNC_CONNECTING) return false;
+  if (millis() - _connectStartMs > _connectTimeoutMs) {
+    _client->close(true);
+    _state = ASYNC_FAILED;
+    return false;
+  }
+  return true;
+}
+
+void AsyncPoolClient::stop() {
+  if (_state == ASYNC_CONNECTED || _state == ASYNC_CONNECTING) {
+    _client->close(true);
+  }
+  _state = ASYNC_IDLE;
+}
+
+size_t AsyncPoolClient::write(const uint8_t *buf, size_t len) {
+  if (_state != ASYNC_CONNECTED) return 0;
+  return _client->write((const char *)buf, len);
+}
+
+// -----------------------------------------------
+//       ------ AsyncTCP task callbacks -------
+// -----------------------------------------------
+
+void AsyncPoolClient::_wakeOwner() {
+  if (_owner != nullptr) xTaskNotifyGive(_owner);
+}
+
+void AsyncPoolClient::_onConnect(void *arg, AsyncClient *c) {
+  AsyncPoolClient* self = static_cast<AsyncPoolClient*>(arg);
+  self->_state = ASYNC_CONNECTED;
+  self->_wakeOwner();
+}
+
+void AsyncPoolClient::_onDisconnect(void *arg, AsyncClient *c) {
+  AsyncPoolClient* self = static_cast<AsyncPoolClient*>(arg);
+  // A refused connect ends up here too
+  uint8_t expected = ASYNC_CONNECTING;
+  if (!self->_state.compare_exchange_strong(expected, ASYNC_FAILED)) {
+    self->_state = ASYNC_IDLE;
+  }
+  self->_wakeOwner();
+}
+
+void AsyncPoolClient::_onError(void *arg, AsyncClient *c, int8_t error) {
+  AsyncPoolClient* self = static_cast<AsyncPoolClient*>(arg);
+  DEBUGPRINT("[POOL] async tcp error: ");
+  DEBUGPRINT_LN(AsyncClient::errorToString(error));
+  uint8_t expected = ASYNC_CONNECTING;
+  self->_state.compare_exchange_strong(expected, ASYNC_FAILED);
+  self->_wakeOwner();
+}
+
+void AsyncPoolClient::_onData(void *arg, AsyncClient *c, void *data, size_t len) {
+  AsyncPoolClient* self = static_cast<AsyncPoolClient*>(arg);
+  const size_t taken = self->_rx.push((const uint8_t *)data, len);
+  if (taken < len) {
+    self->_overflow += len - taken;
+  }
+  self->_wakeOwner();
+}
@@ -0,0 +1,50 @@
+#include "bootArena.h"
+
+#include <Arduino.h>
+#include <stdlib.h>
+
+#if defined(ESP_PLATFORM)
+  #include <esp_heap_caps.h>
+  // What a plain malloc() lines blocks up to
+  #define HEAP_ALIGN  4
+#else
+  #define HEAP_ALIGN  alignof(max_align_t)
+#endif
+
+alignas(16) uint8_t BootArena::_block[BOOT_ARENA_BYTES];
+
+BootArena& BootArena::instance() {
+  static BootArena arena;
+  return arena;
+}
+
+void* BootArena::alloc(size_t size, size_t align) {
+  size_t used = _used.load(std::memory_order_relaxed);
+  for (;;) {
+    const size_t start = (used + align - 1) & ~(align - 1);
+    if (start + size > BOOT_ARENA_BYTES) break;
+    if (_used.compare_exchange_weak(used, start + size, std::memory_order_relaxed)) {
+      return _block + start;
+    }
+  }
+
+  // Full, still boots but the report shows by how much it's too small
+  _overflowCount.fetch_add(1, std::memory_order_relaxed);
+  _overflowBytes.fetch_add(size, std::memory_order_relaxed);
+  void* p = nullptr;
+  if (align <= HEAP_ALIGN) {
+    p = malloc(size);
+  }
+  else {
+  #if defined(ESP_PLATFORM)
+    p = heap_caps_aligned_alloc(align, size, MALLOC_CAP_DEFAULT);
+  #else
+    p = aligned_alloc(align, (size + align - 1) & ~(align - 1));   // size has to be a multiple
+  #endif
+  }
+  if (p == nullptr) {
+    SERIALPRINT_LN("[ARENA] Out of memory");
+    abort();
+  }
+  return p;
+}
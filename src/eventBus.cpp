@@ -0,0 +1,121 @@
+#include "eventBus.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+static_assert((EVENT_BUS_CAPACITY & (EVENT_BUS_CAPACITY - 1)) == 0, "EVENT_BUS_CAPACITY must be a power of two");
+
+EventBus& EventBus::instance() {
+  static EventBus bus;
+  return bus;
+}
+
+EventBus::EventBus() {
+  for (size_t i = 0; i < EVENT_BUS_CAPACITY; i++) {
+    _slots[i].seq.store(0, std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < EVENT_BUS_MAX_SUBSCRIBERS; i++) {
+    _subs[i].name = nullptr;
+    _subs[i].cursor = 0;
+    _subs[i].overflow.store(0, std::memory_order_relaxed);
+    _subs[i].ready.store(false, std::memory_order_relaxed);
+  }
+}
+
+void EventBus::publish(uint8_t source, uint8_t type, uint8_t address,
+                       uint32_t a, uint32_t b, uint32_t c, const char *text) {
+  const uint32_t idx = _head.fetch_add(1, std::memory_order_relaxed);
+  _Slot &slot = _slots[idx & (EVENT_BUS_CAPACITY - 1)];
+
+  // Readers copying this slot see the change of seq and drop their copy
+  slot.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  BusEvent &ev = slot.ev;
+  ev.ms = millis();
+  ev.source = source;
+  ev.type = type;
+  ev.address = address;
+  ev.a = a;
+  ev.b = b;
+  ev.c = c;
+  if (text != nullptr) {
+    strncpy(ev.text, text, EVENT_TEXT_LEN - 1);
+    ev.text[EVENT_TEXT_LEN - 1] = '\0';
+  }
+  else {
+    ev.text[0] = '\0';
+  }
+
+  slot.seq.store(idx + 1, std::memory_order_release);
+}
+
+int8_t EventBus::subscribe(const char *name) {
+  uint8_t n = _claimedSubs.load(std::memory_order_relaxed);
+  for (;;) {
+    if (n >= EVENT_BUS_MAX_SUBSCRIBERS) return -1;
+    if (_claimedSubs.compare_exchange_weak(n, n + 1, std::memory_order_relaxed)) break;
+  }
+
+  // Set the slot up before the count lets readers at it
+  _subs[n].name = name;
+  _subs[n].cursor = _head.load(std::memory_order_acquire);
+  _subs[n].ready.store(true, std::memory_order_release);
+
+  // The count only covers slots that are ready, one claimed earlier and
+  // still being set up holds it back until its own subscribe() gets here
+  uint8_t count = _numSubs.load(std::memory_order_acquire);
+  while (count < EVENT_BUS_MAX_SUBSCRIBERS && _subs[count].ready.load(std::memory_order_acquire)) {
+    _numSubs.compare_exchange_weak(count, count + 1, std::memory_order_release, std::memory_order_acquire);
+  }
+  return n;
+}
+
+size_t EventBus::drain(int8_t sub, BusHandler handler, void *user, size_t max) {
+  if (sub < 0 || sub >= getSubscriberCount()) return 0;
+  _Subscriber &s = _subs[sub];
+
+  size_t handed = 0;
+  while (handed < max) {
+    const uint32_t head = _head.load(std::memory_order_acquire);
+    if (s.cursor == head) break;
+
+    // Lapped, skip to the oldest event still in the ring
+    if (head - s.cursor > EVENT_BUS_CAPACITY) {
+      s.overflow.fetch_add(head - s.cursor - EVENT_BUS_CAPACITY, std::memory_order_relaxed);
+      s.cursor = head - EVENT_BUS_CAPACITY;
+    }
+
+    _Slot &slot = _slots[s.cursor & (EVENT_BUS_CAPACITY - 1)];
+    const uint32_t want = s.cursor + 1;
+    const uint32_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq != want) {
+      // Claimed but not written yet, come back for it next time
+      if (seq == 0 || (int32_t)(seq - want) < 0) break;
+      // Already overwritten by a later lap
+      s.overflow.fetch_add(1, std::memory_order_relaxed);
+      s.cursor++;
+      continue;
+    }
+
+    const BusEvent copy = slot.ev;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    s.cursor++;
+    if (slot.seq.load(std::memory_order_relaxed) != want) {
+      s.overflow.fetch_add(1, std::memory_order_relaxed);   // rewritten while we copied
+      continue;
+    }
+
+    handler(copy, user);
+    handed++;
+  }
+  return handed;
+}
+
+const char* EventBus::getSubscriberName(int8_t sub) const {
+  return (sub >= 0 && sub < getSubscriberCount()) ? _subs[sub].name : nullptr;
+}
+
+uint32_t EventBus::getOverflowCount(int8_t sub) const {
+  return (sub >= 0 && sub < getSubscriberCount()) ? _subs[sub].overflow.load(std::memory_order_relaxed) : 0;
+}
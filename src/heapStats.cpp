@@ -0,0 +1,89 @@
+#include "heapStats.h"
+
+#include <Arduino.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Constant initialised, the malloc wrappers can get here before setup()
+HeapStats HeapStats::_instance;
+
+HeapStats& HeapStats::instance() {
+  return _instance;
+}
+
+void HeapStats::snapshot(Snapshot &out) const {
+  out.freeBytes = ESP.getFreeHeap();
+  out.largestBlock = ESP.getMaxAllocHeap();
+  out.minFreeEver = ESP.getMinFreeHeap();
+}
+
+bool HeapStats::track(const char *name, void *task, bool strict) {
+  const uint8_t n = _count.load(std::memory_order_relaxed);
+  if (n >= HEAP_STATS_MAX_TASKS || task == nullptr) return false;
+  _tasks[n] = _Task{name, task, strict, 0, 0, 0, 0};
+  _count.store(n + 1, std::memory_order_release);
+  return true;
+}
+
+void HeapStats::onAlloc(void *caller) {
+  const int8_t i = _find(xTaskGetCurrentTaskHandle());
+  if (i < 0) {
+    _otherAllocs.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  _Task &t = _tasks[i];
+  t.allocs++;
+  if (!t.strict || t.allowDepth > 0 || !isSteady()) return;
+  t.steadyAllocs++;
+  t.lastCaller = (uintptr_t)caller;
+  #if HEAP_TRACK_ALLOCS >= 2
+    assert(!"allocation on a strict task in steady state");
+  #endif
+}
+
+HeapStats::Allow::Allow() : _slot(HeapStats::instance()._find(xTaskGetCurrentTaskHandle())) {
+  if (_slot >= 0) HeapStats::instance()._tasks[_slot].allowDepth++;
+}
+
+HeapStats::Allow::~Allow() {
+  if (_slot >= 0) HeapStats::instance()._tasks[_slot].allowDepth--;
+}
+
+// -----------------------------------------------
+//               ------ PRIVATE -------
+// -----------------------------------------------
+
+int8_t HeapStats::_find(void *task) const {
+  const uint8_t n = getTaskCount();
+  for (uint8_t i = 0; i < n; i++) {
+    if (_tasks[i].task == task) return i;
+  }
+  return -1;
+}
+
+// Linked in with -Wl,--wrap=malloc etc, new and String end up here too
+#if HEAP_TRACK_ALLOCS
+extern "C" {
+  void* __real_malloc(size_t size);
+  void* __real_calloc(size_t n, size_t size);
+  void* __real_realloc(void *ptr, size_t size);
+
+  void* __wrap_malloc(size_t size) {
+    HeapStats::instance().onAlloc(__builtin_return_address(0));
+    return __real_malloc(size);
+  }
+
+  void* __wrap_calloc(size_t n, size_t size) {
+    HeapStats::instance().onAlloc(__builtin_return_address(0));
+    return __real_calloc(n, size);
+  }
+
+  void* __wrap_realloc(void *ptr, size_t size) {
+    HeapStats::instance().onAlloc(__builtin_return_address(0));
+    return __real_realloc(ptr, size);
+  }
+}
+#endif
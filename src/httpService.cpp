@@ -0,0 +1,181 @@
+#include "config.h"
+#include "httpService.h"
+#include "heapStats.h"
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+
+#define HTTP_TASK_STACK     8192
+#define HTTP_TASK_PRIO      1
+#define HTTP_QUEUE_LEN      8
+#define HTTP_TIMEOUT_MS     5000
+// A TLS session holds a lot of heap, don't keep an unused one around
+#define HTTP_KEEPALIVE_MS   60000UL
+
+static WiFiClientSecure _tls;
+static HTTPClient _http;
+
+static String _hostOf(const String &url) {
+  int start = url.indexOf(':');
+  if (start < 0) return String();
+  start += 3;   // skip "://"
+  int end = url.indexOf('/', start);
+  return (end < 0) ? url.substring(start) : url.substring(start, end);
+}
+
+HttpService& HttpService::instance() {
+  static HttpService service;
+  return service;
+}
+
+void HttpService::begin() {
+  if (_task != nullptr) return;
+
+  _pending = xQueueCreate(HTTP_QUEUE_LEN, sizeof(_Request*));
+  _lock = xSemaphoreCreateMutex();
+  _ownersLock = xSemaphoreCreateMutex();
+  for (uint8_t o = 0; o < _maxOwners; o++) {
+    _owners[o].done = xQueueCreate(HTTP_QUEUE_LEN, sizeof(_Request*));
+  }
+
+  _tls.setInsecure();
+  _http.setReuse(true);
+  _http.setTimeout(HTTP_TIMEOUT_MS);
+
+  if (xTaskCreate(&HttpService::_taskMain, "http_svc", HTTP_TASK_STACK, this, HTTP_TASK_PRIO, &_task) != pdPASS) {
+    _task = nullptr;
+    SERIALPRINT_LN("[HTTP] Can't start http task");
+    return;
+  }
+  HeapStats::instance().track("http", _task);
+}
+
+void HttpService::loop() {
+  if (_pending == nullptr) return;
+
+  const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  int8_t owner = _findOwner(self);
+  if (owner < 0) owner = _addOwner(self);
+  if (owner < 0) return;
+
+  _Request* req = nullptr;
+  while (xQueueReceive(_owners[owner].done, &req, 0) == pdTRUE) {
+    // Answers come as Strings and get parsed, never a steady state thing
+    HeapStats::Allow allow;
+    if (req->cb) req->cb(req->status, req->body, req->user);
+    delete req;
+  }
+}
+
+bool HttpService::get(const String &url, HttpCallback cb, void *user) {
+  // Nobody would ever pick the answer up
+  const int8_t owner = _findOwner(xTaskGetCurrentTaskHandle());
+  if (owner < 0) {
+    SERIALPRINT_LN("[HTTP] get() from a task that doesn't run loop()");
+    return false;
+  }
+
+  _Request* req = new _Request{url, cb, user, (uint8_t)owner, 0, String()};
+  if (xQueueSend(_pending, &req, 0) != pdTRUE) {
+    delete req;
+    return false;
+  }
+  return true;
+}
+
+int HttpService::fetch(const String &url, String &body) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  int status = _perform(url, body);
+  xSemaphoreGive(_lock);
+  return status;
+}
+
+// -----------------------------------------------
+//               ------ PRIVATE -------
+// -----------------------------------------------
+
+void HttpService::_taskMain(void *arg) {
+  HttpService* self = static_cast<HttpService*>(arg);
+
+  for (;;) {
+    _Request* req = nullptr;
+    if (xQueueReceive(self->_pending, &req, pdMS_TO_TICKS(1000)) == pdTRUE) {
+      xSemaphoreTake(self->_lock, portMAX_DELAY);
+      req->status = self->_perform(req->url, req->body);
+      xSemaphoreGive(self->_lock);
+
+      // loop() hasn't kept up, wait for room rather than drop the answer.
+      // Owners are task runners, they're never deleted
+      _Owner& owner = self->_owners[req->owner];
+      xQueueSend(owner.done, &req, portMAX_DELAY);
+      xTaskNotifyGive(owner.task);
+      continue;
+    }
+
+    // Nothing to do, close an idle connection
+    xSemaphoreTake(self->_lock, portMAX_DELAY);
+    if (!self->_lastHost.isEmpty() && millis() - self->_lastUseMs > HTTP_KEEPALIVE_MS) {
+      _tls.stop();
+      self->_lastHost = "";
+    }
+    xSemaphoreGive(self->_lock);
+  }
+}
+
+int8_t HttpService::_findOwner(TaskHandle_t task) const {
+  const uint8_t count = _numOwners.load(std::memory_order_acquire);
+  for (uint8_t o = 0; o < count; o++) {
+    if (_owners[o].task == task) return o;
+  }
+  return -1;
+}
+
+/// @brief Sign the task up for answers. The slot is filled before the
+/// count that makes it visible to the lock free _findOwner()
+int8_t HttpService::_addOwner(TaskHandle_t task) {
+  xSemaphoreTake(_ownersLock, portMAX_DELAY);
+  int8_t owner = _findOwner(task);
+  const uint8_t count = _numOwners.load(std::memory_order_relaxed);
+  if (owner < 0 && count < _maxOwners) {
+    _owners[count].task = task;
+    _numOwners.store(count + 1, std::memory_order_release);
+    owner = count;
+  }
+  xSemaphoreGive(_ownersLock);
+  return owner;     // -1 when full, its get() calls are refused
+}
+
+int HttpService::_perform(const String &url, String &body) {
+  body = "";
+  _requests++;
+
+  const String host = _hostOf(url);
+  if (host == _lastHost && _tls.connected()) {
+    _reused++;      // same host and still open, no handshake
+  }
+  else if (_tls.connected()) {
+    _tls.stop();    // keep-alive only makes sense for the same host
+  }
+
+  if (!_http.begin(_tls, url)) {
+    _failed++;
+    return -1;
+  }
+
+  int httpCode = _http.GET();
+  if (httpCode == HTTP_CODE_OK) {
+    body = _http.getString();
+  }
+  else {
+    _failed++;
+    SERIALPRINT_LN("[HTTP] GET... failed, error: ");
+    SERIALPRINT_LN(HTTPClient::errorToString(httpCode).c_str());
+  }
+  // With reuse on this leaves the connection open if the server allows it
+  _http.end();
+
+  _lastHost = host;
+  _lastUseMs = millis();
+  return httpCode;
+}
@@ -0,0 +1,116 @@
+#if defined(__linux__)
+
+#include "i2c_bus_linux.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+I2CBusLinux::I2CBusLinux(int busNum) : _busNum(busNum) {
+}
+
+I2CBusLinux::~I2CBusLinux() {
+    end();
+}
+
+bool I2CBusLinux::begin() {
+    if (_fd >= 0) return true;
+
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/i2c-%d", _busNum);
+    _fd = open(path, O_RDWR);
+    if (_fd < 0) {
+        perror("[I2C] open");
+        return false;
+    }
+    setTimeout(_timeout);
+    return true;
+}
+
+void I2CBusLinux::end() {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+void I2CBusLinux::setTimeout(uint16_t timeoutMs) {
+    _timeout = timeoutMs;
+    if (_fd >= 0) {
+        // Kernel timeout is in units of 10ms
+        ioctl(_fd, I2C_TIMEOUT, (unsigned long)((timeoutMs + 9) / 10));
+    }
+}
+
+uint8_t I2CBusLinux::write(uint8_t address, const uint8_t *data, size_t len, bool sendStop) {
+    // A STOP always follows an I2C_RDWR message set, a write that wants a
+    // repeated start must go through writeRead()
+    (void)sendStop;
+    if (len > 0xFFFF) return I2C_BUS_ERR_LENGTH;
+
+    struct i2c_msg msg;
+    msg.addr = address;
+    msg.flags = 0;
+    msg.len = (uint16_t)len;
+    msg.buf = const_cast<uint8_t *>(data);
+    return _transfer(&msg, 1);
+}
+
+uint8_t I2CBusLinux::read(uint8_t address, uint8_t *data, size_t len) {
+    if (len > 0xFFFF) return I2C_BUS_ERR_LENGTH;
+
+    struct i2c_msg msg;
+    msg.addr = address;
+    msg.flags = I2C_M_RD;
+    msg.len = (uint16_t)len;
+    msg.buf = data;
+    return _transfer(&msg, 1);
+}
+
+uint8_t I2CBusLinux::writeRead(uint8_t address, const uint8_t *wdata, size_t wlen, uint8_t *rdata, size_t rlen) {
+    if (wlen > 0xFFFF || rlen > 0xFFFF) return I2C_BUS_ERR_LENGTH;
+
+    struct i2c_msg msgs[2];
+    msgs[0].addr = address;
+    msgs[0].flags = 0;
+    msgs[0].len = (uint16_t)wlen;
+    msgs[0].buf = const_cast<uint8_t *>(wdata);
+    msgs[1].addr = address;
+    msgs[1].flags = I2C_M_RD;
+    msgs[1].len = (uint16_t)rlen;
+    msgs[1].buf = rdata;
+    return _transfer(msgs, 2);
+}
+
+// -----------------------------------------------
+//               ------ PRIVATE -------
+// -----------------------------------------------
+
+uint8_t I2CBusLinux::_transfer(void *msgs, unsigned int count) {
+    if (_fd < 0) return I2C_BUS_ERR_OTHER;
+
+    struct i2c_rdwr_ioctl_data xfer;
+    xfer.msgs = static_cast<struct i2c_msg *>(msgs);
+    xfer.nmsgs = count;
+    if (ioctl(_fd, I2C_RDWR, &xfer) >= 0) return I2C_BUS_OK;
+
+    // Map onto the Wire codes the master already understands
+    switch (errno) {
+        case ENXIO:
+        case EREMOTEIO:
+            return I2C_BUS_ERR_NACK;
+        case ETIMEDOUT:
+            return I2C_BUS_ERR_TIMEOUT;
+        case EINVAL:
+        case EMSGSIZE:
+            return I2C_BUS_ERR_LENGTH;
+        default:
+            return I2C_BUS_ERR_OTHER;
+    }
+}
+
+#endif // __linux__
@@ -0,0 +1,103 @@
+#include "config.h"
+#include "i2c_bus_wire.h"
+
+I2CBusWire::I2CBusWire(int sdaPin, int sclPin, uint32_t freq, TwoWire &wire)
+    : _wire(wire), _sdaPin(sdaPin), _sclPin(sclPin), _freq(freq) {
+}
+
+bool I2CBusWire::begin() {
+    DEBUGPRINT("[I2C] Starting wire with pins. SDA: ");
+    DEBUGPRINT(_sdaPin);
+    DEBUGPRINT(" SCL: ");
+    DEBUGPRINT(_sclPin);
+    DEBUGPRINT(" Freq: ");
+    DEBUGPRINT(_freq);
+    DEBUGPRINT_LN();
+
+    bool ok = _wire.begin(_sdaPin, _sclPin, _freq);
+    delay(50);
+    _wire.setTimeOut(_timeout);
+    return ok;
+}
+
+void I2CBusWire::end() {
+    _wire.end();
+}
+
+void I2CBusWire::setTimeout(uint16_t timeoutMs) {
+    _timeout = timeoutMs;
+    _wire.setTimeOut(timeoutMs);
+}
+
+uint8_t I2CBusWire::write(uint8_t address, const uint8_t *data, size_t len, bool sendStop) {
+    _wire.beginTransmission(address);
+    if (len > 0) _wire.write(data, len);
+    return _wire.endTransmission(sendStop);
+}
+
+uint8_t I2CBusWire::read(uint8_t address, uint8_t *data, size_t len) {
+    const size_t got = _wire.requestFrom((uint16_t)address, len, true);
+    if (got != len || !_wire.available()) {
+        while (_wire.available()) _wire.read();
+        // requestFrom() doesn't say why it came back empty, an address
+        // the device won't ACK is a NACK like on a write, not a bus fault
+        if (got == 0 && write(address, nullptr, 0) == I2C_BUS_ERR_NACK) {
+            return I2C_BUS_ERR_NACK;
+        }
+        return I2C_BUS_ERR_TIMEOUT;
+    }
+    for (size_t c = 0; c < len; c++) {
+        data[c] = _wire.read();
+    }
+    while (_wire.available()) _wire.read();    // flush
+    return I2C_BUS_OK;
+}
+
+uint8_t I2CBusWire::writeRead(uint8_t address, const uint8_t *wdata, size_t wlen, uint8_t *rdata, size_t rlen) {
+    uint8_t ret = write(address, wdata, wlen, false);
+    if (ret != I2C_BUS_OK) return ret;
+    return read(address, rdata, rlen);
+}
+
+/// @brief Release a slave holding SDA low. Up to 9 SCL pulses lets the slave
+/// finish clocking out whatever byte it was stuck in, then a STOP is generated
+/// by hand and Wire restarted.
+bool I2CBusWire::recover() {
+    const uint32_t halfBitUs = (500000UL / _freq) + 1;
+
+    _wire.end();
+
+    pinMode(_sdaPin, INPUT_PULLUP);
+    pinMode(_sclPin, OUTPUT_OPEN_DRAIN);
+    digitalWrite(_sclPin, HIGH);
+    delayMicroseconds(halfBitUs);
+
+    for (uint8_t i = 0; i < 9 && digitalRead(_sdaPin) == LOW; i++) {
+        digitalWrite(_sclPin, LOW);
+        delayMicroseconds(halfBitUs);
+        digitalWrite(_sclPin, HIGH);
+        delayMicroseconds(halfBitUs);
+    }
+
+    // STOP: SDA rising while SCL is high
+    pinMode(_sdaPin, OUTPUT_OPEN_DRAIN);
+    digitalWrite(_sclPin, LOW);
+    delayMicroseconds(halfBitUs);
+    digitalWrite(_sdaPin, LOW);
+    delayMicroseconds(halfBitUs);
+    digitalWrite(_sclPin, HIGH);
+    delayMicroseconds(halfBitUs);
+    digitalWrite(_sdaPin, HIGH);
+    delayMicroseconds(halfBitUs);
+
+    pinMode(_sdaPin, INPUT_PULLUP);
+    pinMode(_sclPin, INPUT_PULLUP);
+    const bool released = (digitalRead(_sdaPin) == HIGH);
+
+    begin();
+    return released;
+}
+
+bool I2CBusWire::sdaStuckLow() {
+    return digitalRead(_sdaPin) == LOW;
+}
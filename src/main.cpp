@@ -2,9 +2,15 @@
 #include "network_services.h"
 #include "web.h"
 #include "minerClient.h"
+#include "httpService.h"
+#include "poolDiscovery.h"
 #include "pool.h"
 #include "I2CMaster.h"
 #include "runevery.h"
+#include "taskRunner.h"
+#include "eventBus.h"
+#include "bootArena.h"
+#include "heapStats.h"
 #include "led.h"
 #include "display.h"
 
@@ -14,10 +20,33 @@
 #define REPORT_INTERVAL 60000
 #define REPEATED_WIRE_SEND_COUNT 1      // 1 for AVR, 8 for RP2040
 
+// Tasks. WiFi and AsyncTCP sit on core 0, so hashing gets the other core.
+// The I2C task shares it at a higher priority, it only wakes for the bus
+#if CONFIG_FREERTOS_UNICORE
+  #define TASK_WORK_CORE  0
+#else
+  #define TASK_WORK_CORE  1
+#endif
+#define TASK_UI_CORE      0
+#define TASK_UI_PERIOD_MS 10
+#define TASK_MINER_MAX_SLEEP_MS 100   // the miners say when they're next due
+#define TASK_UI_STACK     6144
+#define TASK_I2C_STACK    8192
+#define TASK_HASH_STACK   8192
+
 #if defined(MINE_ON_MASTER)
-  MinerClient *masterMiner;
+  MinerClient *masterMiner = nullptr;
 #endif
-MinerClient *slaveMiner;
+MinerClient *slaveMiner = nullptr;
+
+TaskRunner *uiTask = nullptr;
+TaskRunner *i2cTask = nullptr;
+TaskRunner *hashTask = nullptr;
+RunEvery taskReportTimer(REPORT_INTERVAL);
+
+// EventBus cursors, drained on the UI task
+int8_t serialEvents = -1;
+int8_t ledEvents = -1;
 
 void restart_esp(String msg);
 
@@ -32,28 +61,183 @@ void restart_esp(String msg) {
   #endif
 }
 
-// Example: bridge events to your I2C master, WS, or Serial
-void minerEventSink(MinerEvent ev, const MinerEventData& d) {
-  switch (ev) {
-    case ME_SOLVED:
-      DEBUGPRINT("[DUCO] Solved: nonce=");
-      DEBUGPRINT((unsigned long)d.nonce);
-      DEBUGPRINT(", HR=");
-      DEBUGPRINT(d.hashrate_khs);
-      DEBUGPRINT(" kH/s\n");
+// Don't leave the slaves grinding jobs nobody will submit while we flash.
+// Runs on the UI task, the miners are told rather than called
+void onOtaStart() {
+  if (slaveMiner != nullptr && slaveMiner->post(MC_SHUTDOWN)) i2cTask->notify();
+  #if defined(MINE_ON_MASTER)
+    if (masterMiner != nullptr && masterMiner->post(MC_SHUTDOWN)) hashTask->notify();
+  #endif
+}
+
+void printTaskReport() {
+  char buf[96];
+  SERIALPRINT_LN(F("************ TASKS ************"));
+  for (uint8_t i = 0; i < TaskRunner::getCount(); i++) {
+    TaskRunner::get(i)->formatReport(buf, sizeof(buf));
+    SERIALPRINT_LN(buf);
+  }
+
+  EventBus& bus = EventBus::instance();
+  snprintf(buf, sizeof(buf), "Events %u, dropped:", bus.getPublishedCount());
+  SERIALPRINT(buf);
+  for (uint8_t i = 0; i < bus.getSubscriberCount(); i++) {
+    snprintf(buf, sizeof(buf), " %s %u", bus.getSubscriberName(i), bus.getOverflowCount(i));
+    SERIALPRINT(buf);
+  }
+  SERIALPRINT_LN("");
+
+  BootArena& arena = BootArena::instance();
+  snprintf(buf, sizeof(buf), "Boot arena: %u / %u bytes, overflow %u (%u bytes)",
+    (unsigned)arena.getUsed(), (unsigned)arena.getCapacity(),
+    arena.getOverflowCount(), (unsigned)arena.getOverflowBytes());
+  SERIALPRINT_LN(buf);
+
+  #if HEAP_TRACK_ALLOCS
+    HeapStats& heap = HeapStats::instance();
+    for (uint8_t i = 0; i < heap.getTaskCount(); i++) {
+      snprintf(buf, sizeof(buf), "  %-8s allocs %8u  steady %6u  last %#x",
+        heap.getTaskName(i), heap.getAllocCount(i), heap.getSteadyAllocCount(i),
+        (unsigned)heap.getLastSteadyCaller(i));
+      SERIALPRINT_LN(buf);
+    }
+    snprintf(buf, sizeof(buf), "  %-8s allocs %8u", "other", heap.getOtherAllocCount());
+    SERIALPRINT_LN(buf);
+  #endif
+
+  // A report interval in the pools are up and the workers mining
+  HeapStats::instance().markSteady();
+}
+
+static void printEventPrefix(const BusEvent &ev, bool isDebug) {
+  if(isDebug) {
+    DEBUGPRINT("[MINER CLIENT] 0x");
+    DEBUGPRINT_HEX(ev.address);
+    DEBUGPRINT(" - ");
+  }
+  else {
+    SERIALPRINT("[MINER CLIENT] 0x");
+    SERIALPRINT_HEX(ev.address);
+    SERIALPRINT(" - ");
+  }
+}
+
+// What the miners used to print straight from their event callbacks
+void serialEventSink(const BusEvent &ev, void *user) {
+  if (ev.source == BUS_MINER) {
+    switch (ev.type) {
+      case ME_SOLVED:
+        DEBUGPRINT("[DUCO] Solved: nonce=");
+        DEBUGPRINT((unsigned long)ev.a);
+        DEBUGPRINT(", HR=");
+        DEBUGPRINT(ev.b * 0.001f);
+        DEBUGPRINT(" kH/s\n");
+        break;
+      case ME_SOLVE_FAILED:
+        DEBUGPRINT_LN("[DUCO] Failed to solve hash.\n");
+        break;
+      case ME_ERROR:
+        DEBUGPRINT("[DUCO] Error: ");
+        DEBUGPRINT_LN(ev.text);
+        break;
+      default:
+        break;
+    }
+    return;
+  }
+
+  switch (ev.type) {
+    case POOLEVT_CONNECTED:
+      printEventPrefix(ev, true);
+      DEBUGPRINT_LN("POOLEVT_CONNECTED");
+      DEBUGPRINT_LN(ev.text);
+      break;
+    case POOLEVT_DISCONNECTED:
+      printEventPrefix(ev, true);
+      DEBUGPRINT_LN("POOLEVT_DISCONNECTED");
+      break;
+    case POOLEVT_MOTD:
+      printEventPrefix(ev, true);
+      DEBUGPRINT_LN("POOLEVT_MOTD");
+      DEBUGPRINT_LN(ev.text);
+      break;
+    case POOLEVT_JOB_REQUESTED:
+      printEventPrefix(ev, true);
+      DEBUGPRINT_LN("POOLEVT_REQUESTED");
+      break;
+    case POOLEVT_JOB_RECEIVED:
+      printEventPrefix(ev, true);
+      DEBUGPRINT("POOLEVT_JOB_RECEIVED - ");
+      DEBUGPRINT(ev.text);
+      DEBUGPRINT(" | ");
+      DEBUGPRINT_LN(ev.a);
+      break;
+    case POOLEVT_RESULT_GOOD:
+      printEventPrefix(ev, true);
+      DEBUGPRINT_LN("Share accepted");
+      break;
+    case POOLEVT_RESULT_BAD:
+      printEventPrefix(ev, false);
+      SERIALPRINT("Share rejected: ");
+      SERIALPRINT(ev.text);
+      SERIALPRINT("  Diff: ");
+      SERIALPRINT(ev.c);
+      SERIALPRINT("  Last Nonce: ");
+      SERIALPRINT(ev.a);
+      SERIALPRINT(".  Time: ");
+      SERIALPRINT(ev.b);
+      SERIALPRINT("ms");
+      SERIALPRINT("  HR: ");
+      SERIALPRINT(ev.b ? ev.a / (ev.b * 0.001f) : 0.0f);
+      SERIALPRINT_LN("");
+      break;
+    case POOLEVT_RESULT_BLOCK:
+      printEventPrefix(ev, true);
+      DEBUGPRINT_LN("Found a BLOCK ... Whoa!");
+      break;
+    case POOLEVT_ERROR:
+      printEventPrefix(ev, false);
+      SERIALPRINT("POOLEVT_ERROR: ");
+      SERIALPRINT_LN(ev.text);
+      break;
+    default:
+      break;
+  }
+}
+
+void ledEventSink(const BusEvent &ev, void *user) {
+  if (ev.source != BUS_POOL) return;
+  switch (ev.type) {
+    case POOLEVT_RESULT_GOOD:
+      blinkStatus(ev.address == 0 ? BLINK_SHARE_GOOD : BLINK_SLAVE_SHARE_GOOD);
       break;
-    case ME_SOLVE_FAILED:
-      DEBUGPRINT_LN("[DUCO] Failed to solve hash.\n");
+    case POOLEVT_RESULT_BAD:
+      blinkStatus(BLINK_SHARE_ERROR);
       break;
-    case ME_ERROR:
-      DEBUGPRINT("[DUCO] Error: ");
-      DEBUGPRINT_LN(d.text ? d.text : "");
+    case POOLEVT_RESULT_BLOCK:
+      blinkStatus(BLINK_SHARE_BLOCKFOUND);
       break;
     default:
       break;
   }
 }
 
+// OTA, the web pages and the task report
+uint32_t uiStep(void *arg) {
+  ArduinoOTA.handle();
+  EventBus::instance().drain(serialEvents, serialEventSink);
+  EventBus::instance().drain(ledEvents, ledEventSink);
+  web_loop();
+  if (taskReportTimer.shouldRun()) printTaskReport();
+  return TASK_UI_PERIOD_MS;
+}
+
+// A miner and the http answers it asked for, on the task that owns it
+uint32_t minerStep(void *arg) {
+  HttpService::instance().loop();
+  return static_cast<MinerClient*>(arg)->loop();
+}
+
 // SETUP
 void setup() {
   Serial.begin(115200);
@@ -73,36 +257,44 @@ void setup() {
   wifi_setup();
   showWiFi();
 
-  ota_setup();
+  // Shared by the tasks, up before any of them
+  HttpService::instance().begin();
+  PoolDiscovery::instance().begin();
+
+  ota_setup(onOtaStart);
   
   web_setup();
 
   SERIALPRINT_LN("Ready for action!");
+
+  serialEvents = EventBus::instance().subscribe("serial");
+  ledEvents = EventBus::instance().subscribe("led");
   
   #if defined(MINE_ON_MASTER)
-    masterMiner = new MinerClient(DUCO_USER, true);
-    masterMiner->onEvent(minerEventSink);
-    masterMiner->getAttachedPool()->onEvent(poolEventSink);
+    masterMiner = BootArena::instance().make<MinerClient>(DUCO_USER, true);
     masterMiner->setMining(true);         // Start mining once connected
   #endif
 
-  slaveMiner = new MinerClient(DUCO_USER, false);
-  slaveMiner->onEvent(minerEventSink);
+  slaveMiner = BootArena::instance().make<MinerClient>(DUCO_USER, false);
   slaveMiner->setupSlaves();
   slaveMiner->setMining(true);
+
+  // From here on each miner belongs to its task
+  i2cTask = BootArena::instance().make<TaskRunner>("i2c", minerStep, slaveMiner, TASK_MINER_MAX_SLEEP_MS, TASK_I2C_STACK, 2, TASK_WORK_CORE);
+  i2cTask->setHeapStrict(true);
+  i2cTask->start();
+  #if defined(MINE_ON_MASTER)
+    hashTask = BootArena::instance().make<TaskRunner>("hash", minerStep, masterMiner, TASK_MINER_MAX_SLEEP_MS, TASK_HASH_STACK, 1, TASK_WORK_CORE);
+    hashTask->setHeapStrict(true);
+    hashTask->start();
+  #endif
+  uiTask = BootArena::instance().make<TaskRunner>("ui", uiStep, nullptr, TASK_UI_PERIOD_MS, TASK_UI_STACK, 1, TASK_UI_CORE);
+  uiTask->start();
+
   ledSetupUpFinished();
 }
 
 void loop() {
-  ArduinoOTA.handle();
-
-  web_loop();
-
-  slaveMiner->loop();
-
-  #if defined(MINE_ON_MASTER)
-    masterMiner->loop();
-    // Small delay to keep CPU cool; adjust as needed
-    delay(5);
-  #endif
+  // Everything runs on the tasks started in setup()
+  vTaskDelete(NULL);
 }
@@ -2,12 +2,14 @@
 #include "config.h"
 #include "utils.h"
 #include "pool.h"
+#include "poolDiscovery.h"
 #include "I2CMaster.h"
-//#include "wirewrap.h"
+#include "wirewrap.h"
 #include "network_services.h"
 #include "Counter.h"
 #include "DSHA1.h"
-#include "led.h"
+#include "bootArena.h"
+#include "heapStats.h"
 
 #include <Arduino.h>
 #include <WiFiClient.h>
@@ -15,6 +17,42 @@
 #define CLIENT_TIMEOUT_CONNECTION 30000
 #define STATE_STUCK_TIMEOUT 30000UL
 
+// How often a worker is looked at while it waits on something. Pool events
+// and lease hand overs wake a worker at once, these are the fall backs
+#define POLL_IDLE_MS            20
+#define POLL_JOB_REQ_MS         25      // minimum time to re-request a job
+#define POLL_JOB_WAIT_MS        50
+#define POLL_SLAVE_STATUS_MS    40      // slave result, until its hash rate is known
+#define POLL_SLAVE_PER_JOB      16      // status polls spread over the predicted job time
+#define POLL_SLAVE_MIN_MS       4
+#define POLL_SLAVE_MAX_MS       250
+#define POLL_SLAVE_PROGRESS_MS  1000UL
+#define POLL_GROUP_WAIT_MS      100
+#define POLL_POOL_MS            50      // pool timeouts, pool data wakes the task anyway
+
+// A job that never turns up is the pool's problem, not the worker's
+#define JOB_WAIT_TIMEOUT_MS     10000UL
+// A slave is overdue this many times its predicted job time, plus the grace
+#define JOB_OVERDUE_FACTOR      3
+#define JOB_OVERDUE_GRACE_MS    2000UL
+
+// Worker health, 1 is healthy. Each fault knocks some off, each good
+// result wins a tenth of the rest back. Below HEALTH_QUARANTINE the worker
+// sits out for QUARANTINE_BASE_MS, doubling for every quarantine it's had
+// since it was last fully healthy
+#define HEALTH_PENALTY_TIMEOUT  0.35f   // stuck, stalled or overdue
+#define HEALTH_PENALTY_RESULT   0.25f   // wrong or missing nonce, failed transfer
+#define HEALTH_PENALTY_REJECT   0.10f   // rejected by the pool
+#define HEALTH_QUARANTINE       0.30f
+#define HEALTH_PROBATION        0.60f   // where it starts again after quarantine
+#define HEALTH_RECOVERED        0.90f   // resets the backoff
+#define QUARANTINE_BASE_MS      30000UL
+#define QUARANTINE_MAX_SHIFT    5       // 16 minutes at most
+// A slave whose nonce hasn't moved for this long is treated as hung
+#define SLAVE_STALL_TIMEOUT 3000UL
+
+void static _printMinerPrefix(uint16_t address, bool isDebug);
+
 // ---------------- ctor/config ----------------
 // Master / Slave flag must be set in ctor as not mutable
 MinerClient::MinerClient(const String username, bool isMaster)
@@ -25,16 +63,19 @@ MinerClient::MinerClient(const String username, bool isMaster)
 
 void MinerClient::init() {
   if(_isMasterMiner) {
+    _allocClients(1);
     _numMinerClients = 1;
-    _clients[0]._pool = new Pool(_username, MINING_KEY, DEVICE_ESP32);
-    _clients[0]._pool->setMinerName("NDMaster");
-    // Only for masters
-    _dsha1 = new DSHA1();
-    _dsha1->warmup();
+    _clients[0].poolSlot = 0;
+    _pools = BootArena::instance().make<PoolManager>(_username, MINING_KEY);
+    _pools->begin(1);
+    _pools->setWorker(0, "NDMaster", DEVICE_ESP32, &MinerClient::_poolEventSink, &_clients[0]);
   }
   else {
-    _i2c = new I2CMaster();
+    _i2c = BootArena::instance().make<I2CMaster>();
   }
+  // Mines on a master, checks the slaves' results otherwise
+  _dsha1 = BootArena::instance().make<DSHA1>();
+  _dsha1->warmup();
 }
 
 Pool* MinerClient::getAttachedPool(int idx) {
@@ -45,7 +86,8 @@ Pool* MinerClient::getAttachedPool(int idx) {
     return nullptr;
   }
 
-  return _clients[idx]._pool;
+  if(_pools == nullptr || idx >= _numMinerClients || _clients[idx].poolSlot < 0) return nullptr;
+  return _pools->getPool(_clients[idx].poolSlot);
 }
 
 void MinerClient::onEvent(MinerEventCallback cb) {
@@ -54,6 +96,7 @@ void MinerClient::onEvent(MinerEventCallback cb) {
 
 void MinerClient::reset() {
   for(uint8_t c=0; c < _numMinerClients; c++) {
+    _abortSlaveJob(c);
     _setState(DUINO_STATE_NONE, c);
   }
 }
@@ -62,15 +105,30 @@ void MinerClient::setMining(bool flag) {
   _isMining = flag;
 
     for(uint8_t c=0; c < _numMinerClients; c++) {
-      if(flag == false) {
-        _clients[c]._pool->disconnect();
+      // Whatever the slave is working on belongs to the old pool session
+      _abortSlaveJob(c);
+      _releasePool(c);
+
+      // Workers with a pool slot queue for a connection, members wait for their leader.
+      // A quarantine outlasts a restart
+      if(flag && _clients[c].poolSlot >= 0) {
+        _setState((_clients[c].groupSize == 1 && _isQuarantined(c)) ? DUINO_STATE_QUARANTINE : DUINO_STATE_IDLE, c);
+      }
+      else {
+        _setState(DUINO_STATE_NONE, c);
       }
-      
-      // Set state to none in both cases
-      _setState(DUINO_STATE_NONE, c);
+    }
+
+    if(_pools != nullptr) {
+      _pools->setMining(flag);
     }
 }
 
+void MinerClient::shutdown() {
+  SERIALPRINT_LN("[MINER_CLIENT] Shutting down, aborting slave jobs");
+  setMining(false);
+}
+
 // Setup our slave devices
 // This might get rolled into the start-up code at some point
 // for the moment leave as function to call separately 
@@ -78,145 +136,341 @@ bool MinerClient::setupSlaves() {
   assert(!_isMasterMiner);
 
   if(_i2c == nullptr) {
-    _i2c = new I2CMaster();
+    _i2c = BootArena::instance().make<I2CMaster>();
   }
 
   _i2c->scan(true);
-  _numMinerClients = _i2c->getFoundSlaveCount(); 
-  if(_numMinerClients > 0) {
+  const uint8_t foundSlaves = _i2c->getFoundSlaveCount();
+  _allocClients(foundSlaves);
+  _numMinerClients = 0;
+  uint8_t numPoolWorkers = 0;
+  if(foundSlaves > 0) {
     _i2c->dumpSlaves();
     // setup a client for each slave as each one needs it's own pool connection etc
-    for(uint8_t c = 0; c < _numMinerClients; c++) {
-      auto& client = _clients[c];
-      client._pool = new Pool(_username, MINING_KEY, DEVICE_AVR);
-      client._address = _i2c->getFoundSlaveAddress(c);
-      client._pool->setMinerName(String("AVRSlave") + String(_clients[c]._address, HEX));
-      client._pool->addEventListener(&MinerClient::_poolEventSink, &_clients[c] );
-      client.startTimeMs = millis();  // TODO take into account connect to pool time
-
-      // Delay a bit between slave by a jitter amount
-      delay(48);
-      if(c%2) delay(16);
+    // Native slaves go first so cooperative groups stay contiguous, stock
+    // firmware slaves can't take range jobs and always mine on their own
+    for(uint8_t pass = 0; pass < 2; pass++) {
+      for(uint8_t s = 0; s < foundSlaves; s++) {
+        I2CMaster::I2C_SLAVE *slave = _i2c->getFoundSlave(s);
+        const bool isLegacy = (slave->protocol == I2CMaster::I2C_PROTO_LEGACY);
+        if(isLegacy != (pass == 1)) continue;
+
+        const uint8_t c = _numMinerClients++;
+        auto& client = _clients[c];
+        client._address = slave->address;
+        client.stats->startTimeMs = millis();
+        client.groupLeader = c;
+
+        if(isLegacy) {
+          client.legacy = BootArena::instance().make<WireWrapSlave>(_i2c, client._address);
+          client.legacy->begin();
+        }
+        else if(I2C_GROUP_SIZE > 1) {
+          // Group members share their leader's pool connection
+          client.groupLeader = c - (c % I2C_GROUP_SIZE);
+          if(client.groupLeader != c) {
+            _clients[client.groupLeader].groupSize++;
+            continue;
+          }
+        }
+
+        client.poolSlot = numPoolWorkers++;
+      }
     }
   }
+
+  // Everyone who talks to the pool shares POOL_MAX_CONNECTIONS sockets
+  if(_pools == nullptr) {
+    _pools = BootArena::instance().make<PoolManager>(_username, MINING_KEY);
+    _pools->begin(numPoolWorkers);
+  }
+  for(uint8_t c = 0; c < _numMinerClients; c++) {
+    auto& client = _clients[c];
+    if(client.poolSlot < 0) continue;
+    const DeviceType type = (client.legacy == nullptr && I2C_GROUP_SIZE > 1) ? DEVICE_AVR_GROUP : DEVICE_AVR;
+    _pools->setWorker(client.poolSlot, String("AVRSlave") + String(client._address, HEX),
+      type, &MinerClient::_poolEventSink, &client);
+  }
   return true;
 }
 
-void MinerClient::loop() {
+bool MinerClient::post(MinerCommand cmd) {
+  return _commands.push(cmd);
+}
+
+uint32_t MinerClient::loop() {
+  _runCommands();
+
   if(_reportTimer.shouldRun()) {
     _printReport();
   }
 
-  for(u_int8_t c = 0; c < _numMinerClients; c++) {
-    auto& client = _clients[c];
+  if(_pools != nullptr) {
+    _pools->loop();     // events wake the workers they're for
+  }
 
-    // If we're mining always check if we're still connected, if not then
-    // any work will be lost and force new pool connection
-    if(_isMining && !client._pool->isConnected() ) {
-      client._pool->connect();
-      _setState(DUINO_STATE_IDLE, c);     // can't mine if pool not connected
+  // Only the workers whose deadline has come
+  _nowUs = micros();
+  uint8_t c;
+  while(_schedule.popDue(_nowUs, c)) {
+    _runWorker(c);
+    // Nothing moved it on, look again after its state's poll interval
+    if(!_schedule.contains(c) && _clients[c]._state != DUINO_STATE_NONE) {
+      _scheduleNext(c);
     }
+  }
 
-    client._pool->loop();
+  // Sleep until the next deadline, the pools want a look now and then
+  uint32_t sleepMs = POLL_POOL_MS;
+  uint8_t next;
+  uint32_t dueUs;
+  if(_schedule.peek(next, dueUs)) {
+    const int32_t untilUs = (int32_t)(dueUs - micros());
+    if(untilUs <= 0) return 0;
+    sleepMs = min(sleepMs, ((uint32_t)untilUs + 999) / 1000);
+  }
+  return sleepMs;
+}
+
+void MinerClient::_runWorker(int c) {
+  auto& client = _clients[c];
+
+  // Rejects the pool told us about since the last look
+  for(; client.pendingRejects > 0; client.pendingRejects--) {
+    if(_healthEvent(c, HEALTH_REJECTED)) {
+      client.pendingRejects = 0;
+      return;
+    }
+  }
+
+  // Nothing should sit in one state this long, drop the work and start over
+  if(_isStateStuck(c)) {
+    _printMinerPrefix(client._address, false);
+    SERIALPRINT("stuck in state ");
+    SERIALPRINT(client._state);
+    SERIALPRINT_LN(", resetting");
+    // Only the slave's fault if it was the slave we were waiting on
+    if(client._state == DUINO_STATE_MINING_I2C && _healthEvent(c, HEALTH_TIMEOUT)) {
+      return;
+    }
+    _resetWorker(c);
+  }
+
+  // If we're mining always check the leased connection is still up, if
+  // not then any work will be lost, queue again for a new one
+  if(_isMining && client._pool != nullptr && !client._pool->isConnected()) {
+    if(client.groupSize > 1) {
+      _abortGroup(c);
+    }
+    else {
+      _abortSlaveJob(c);
+    }
+    _releasePool(c);
+    _setState(DUINO_STATE_IDLE, c);     // can't mine if pool not connected
+  }
 
-    switch (client._state) {
-      case DUINO_STATE_NONE:
-        // NO-OP
+  switch (client._state) {
+    case DUINO_STATE_NONE:
+      // NO-OP
+      break;
+
+    case DUINO_STATE_IDLE:
+      if(_isMining && _acquirePool(c)) {
+        _setState(DUINO_STATE_JOB_REQUEST, c);
+      }
+      break;
+
+    case DUINO_STATE_JOB_REQUEST:
+      if(!_isMining) {
+        return;
+      }
+
+      // Had our turn, let the next worker on the connection have its go
+      if(client.leaseSubmitted && client._pool->isIdle() && _pools->hasWaiters(client.poolSlot)) {
+        _releasePool(c);
+        _setState(DUINO_STATE_IDLE, c);
         break;
+      }
 
-      case DUINO_STATE_IDLE:
-        if(_isMining && client._pool->isConnected()) {
-          _setState(DUINO_STATE_JOB_REQUEST, c);
+      // Refused, e.g. the connection is still busy, retried after POLL_JOB_REQ_MS
+      if(client._pool->requestJob()) {
+        client.jobOutstanding = true;
+        _setState(DUINO_STATE_JOB_WAIT, c);
+      }
+      break;
+
+    case DUINO_STATE_JOB_WAIT: {
+      Job* job = client._pool->getJob();
+      if(job != nullptr) {
+        client.work->job = *job;
+        client.verifyFailures = 0;
+        _setState(DUINO_STATE_MINING, c);
         }
-        break;
+      else if(millis() - client._stateStartMS > JOB_WAIT_TIMEOUT_MS) {
+        _printMinerPrefix(client._address, false);
+        SERIALPRINT_LN("no job from the pool, reconnecting");
+        _resetWorker(c);
+      }
+      break;
+      }
 
-      case DUINO_STATE_JOB_REQUEST:
-        if(!_isMining) {
+    case DUINO_STATE_MINING:
+      {
+        if(!_isMining)
           return;
-        }
 
-        if(client.slaveJobReqTimer.shouldRun()) {
-          if(client._pool->requestJob()) {
-            _setState(DUINO_STATE_JOB_WAIT, c);
+        if(_isMasterMiner) {
+          client._jobStartTime = millis();
+          if (_solveAndSubmit(client.work->job, client.work->job.difficulty * 100 + 1)) {
+            // Update stats
+            client.stats->share_count++;
+          } else {
+            _dropJob(c);  // start again
           }
         }
-        break;
-
-      case DUINO_STATE_JOB_WAIT: {
-        Job* job = client._pool->getJob();
-        if(job != nullptr) {
-          strncpy(client.seed, job->prevHash.c_str(), 40);
-          client.seed[40] = '\0';
-          strncpy(client.target, job->expectedHash.c_str(), 40);
-          client.target[40] = '\0';
-          client.diff = job->difficulty;
-          _setState(DUINO_STATE_MINING, c);
+        else if(client.legacy != nullptr) {
+          // Stock firmware slave, the driver trickles the job out
+          if(client.legacy->startJob(client.work->job)) {
+            client._jobStartTime = millis();
+            _setState(DUINO_STATE_MINING_I2C, c);
+          }
+          else {
+            _dropJob(c);
           }
-        break;
         }
-
-      case DUINO_STATE_MINING:
-        {
-          if(!_isMining)
-            return;
-
-          if(_isMasterMiner) {
-            if (_solveAndSubmit(client.seed, client.target, client.diff * 100 + 1)) {
-              _setState(DUINO_STATE_SHARE_SUBMITTED, c);
-              // Update stats
-              client.stats_share_count++;
-            } else {
-              _setState(DUINO_STATE_JOB_REQUEST, c);  // start again
+        else if(client.groupSize > 1) {
+          // Split the job over the group
+          _dispatchGroupJob(c);
+        }
+        else {
+          // Need to send to worker slave device
+          if(!_i2c->sendJobData(_clients[c]._address, client.work->job, (uint8_t)client.work->job.difficulty)) {
+            if(!_healthEvent(c, HEALTH_BAD_RESULT)) {
+              _dropJob(c);
             }
+            break;
           }
-          else {
-            // Need to send to worker slave device
-            _i2c->sendJobData(_clients[c]._address, client.seed, client.target, (uint8_t)client.diff);
-            client._jobStartTime = millis();
-            _setState(DUINO_STATE_MINING_I2C, c);
-          }
-          break;
+          client._jobStartTime = millis();
+          _startProgress(c, 0, client.work->job.difficulty * 100 + 1);
+          _setState(DUINO_STATE_MINING_I2C, c);
         }
+        break;
+      }
 
-      case DUINO_STATE_MINING_I2C:
-        // test if job solved
-        if(client.slaveMiningStatusTimer.shouldRun()) {
-          uint16_t found_nonce;
-          uint16_t timeTaken;
-          if(_i2c->getJobResult(_clients[c]._address, found_nonce, timeTaken)) {
-            if(found_nonce == 0) {
-              // although work finished, error. Probably start diff too high
-              _setState(DUINO_STATE_NONE, c); // stop while we test
-              break;
-            }
-            uint16_t masterTimeTakenMs = millis() - client._jobStartTime;
-            DEBUGPRINT("[MINER_CLIENT] i2c slave solved hash in ");
-            DEBUGPRINT(timeTaken);
-            DEBUGPRINT("ms. Master Estimate: ");
-            DEBUGPRINT_LN(masterTimeTakenMs);
+    case DUINO_STATE_MINING_I2C:
+      if(client.legacy != nullptr) {
+        _pollLegacy(c);
+        break;
+      }
 
-            // Update stats
-            client.stats_share_count++;
-            client.lastNonce = found_nonce;
-            client.lastTimeTakenMs = masterTimeTakenMs;
-            client.lastHashRate = found_nonce / (masterTimeTakenMs * 0.001f);
+      if((int32_t)(_nowUs - client.nextProgressUs) >= 0) {
+        client.nextProgressUs = _nowUs + POLL_SLAVE_PROGRESS_MS * 1000UL;
+        if(!_updateProgress(c)) {
+          break;    // stalled and reset
+        }
+        if(_schedule.contains(c)) {
+          break;    // just heard it's still searching, the status can wait
+        }
+      }
 
-            client._pool->submitJob(found_nonce, masterTimeTakenMs * 1000);
+      if(_isOverdue(c)) {
+        _printMinerPrefix(client._address, false);
+        SERIALPRINT_LN("job overdue, giving it up");
+        _abortSlaveJob(c);
+        if(_clients[client.groupLeader].groupSize > 1) {
+          _healthEvent(c, HEALTH_TIMEOUT);
+          _groupMemberDone(c, 0);
+        }
+        else if(!_healthEvent(c, HEALTH_TIMEOUT)) {
+          _dropJob(c);
+        }
+        break;
+      }
 
-            _setState(DUINO_STATE_JOB_REQUEST, c);  // start again
+      // test if job solved
+      if(_clients[client.groupLeader].groupSize > 1) {
+        uint32_t found_nonce;
+        uint16_t timeTaken;
+        client.stats->status_polls++;
+        if(_i2c->getJobResultRange(client._address, found_nonce, timeTaken)) {
+          _notePickup(c, (found_nonce ? found_nonce : client.rangeEnd) - client.rangeStart, timeTaken);
+          if(found_nonce == 0) {
+            _healthEvent(c, HEALTH_OK);     // searched its slice, nothing there
           }
+          else if(!_checkSlaveResult(c, found_nonce)) {
+            if(client.verifyFailures & 1) break;   // read it again on the next poll
+            client.stats->local_reject_count++;
+            _healthEvent(c, HEALTH_BAD_RESULT);
+            found_nonce = 0;    // count the slice as searched
+          }
+          _groupMemberDone(c, found_nonce);
         }
-        break;
+      }
+      else {
+        uint16_t found_nonce;
+        uint16_t timeTaken;
+        client.stats->status_polls++;
+        if(_i2c->getJobResult(_clients[c]._address, found_nonce, timeTaken)) {
+          if(found_nonce == 0) {
+            // Finished without a nonce, e.g. the start diff was too high
+            if(!_healthEvent(c, HEALTH_BAD_RESULT)) {
+              _dropJob(c);
+            }
+            break;
+          }
+          _notePickup(c, found_nonce, timeTaken);
+          if(!_checkSlaveResult(c, found_nonce)) {
+            if(client.verifyFailures & 1) break;   // read it again on the next poll
+            client.stats->local_reject_count++;
+            if(!_healthEvent(c, HEALTH_BAD_RESULT)) {
+              // Give the slave the job once more before moving on
+              if(client.verifyFailures < 4) {
+                _setState(DUINO_STATE_MINING, c);
+              }
+              else {
+                _dropJob(c);
+              }
+            }
+            break;
+          }
+          DEBUGPRINT("[MINER_CLIENT] i2c slave solved hash in ");
+          DEBUGPRINT(timeTaken);
+          DEBUGPRINT_LN("ms.");
+          _submitSlaveResult(c, found_nonce);
+        }
+      }
+      break;
 
-      case DUINO_STATE_SHARE_SUBMITTED:    
-        // Get a new job, regardless of the result
-        _setState(DUINO_STATE_JOB_REQUEST, c);
-        break;
+    case DUINO_STATE_GROUP_WAIT:
+      // NO-OP, the members move the leader on when they finish
+      break;
 
-      default:
-        DEBUGPRINT_LN("[MINER_CLIENT] Unknown State");
-        break;
+    case DUINO_STATE_QUARANTINE:
+      if(_isQuarantined(c)) {
+        _runIn(c, client.quarantineUntilMs - millis());
+      }
+      else {
+        _setState((_isMining && client.poolSlot >= 0) ? DUINO_STATE_IDLE : DUINO_STATE_NONE, c);
       }
+      break;
+
+    case DUINO_STATE_SHARE_HOLD:
+      if((int32_t)(millis() - client.holdUntilMs) >= 0) {
+        _releaseShare(c);
+      }
+      else {
+        _runIn(c, client.holdUntilMs - millis());
+      }
+      break;
+
+    case DUINO_STATE_SHARE_SUBMITTED:    
+      // Get a new job, regardless of the result. A pipelined one is already asked for
+      _setState(client.jobOutstanding ? DUINO_STATE_JOB_WAIT : DUINO_STATE_JOB_REQUEST, c);
+      break;
+
+    default:
+      DEBUGPRINT_LN("[MINER_CLIENT] Unknown State");
+      break;
     }
 }
 
@@ -225,12 +479,17 @@ void MinerClient::loop() {
   diff = the job diff * 100 + 1
 */
 bool MinerClient::findNonce(const char *seed40, const char *target40, uint32_t diff, uint32_t &nonce_found, uint32_t &elapsed_time_us)
+{
+  Job job;
+  decodeJob(job, seed40, target40, 0, 0);
+  return findNonce(job, diff, nonce_found, elapsed_time_us);
+}
+
+bool MinerClient::findNonce(const Job &job, uint32_t diff, uint32_t &nonce_found, uint32_t &elapsed_time_us)
 {
 uint8_t __hashArray[20];
-uint8_t __expected_hash[20];
 
-  hexStringToUint8Array(target40, __expected_hash, 20);
-  _dsha1->reset().write( (const unsigned char *)seed40, 40);
+  _dsha1->reset().write( (const unsigned char *)job.seedHex, 40);
 
   const uint32_t start_time = micros();
   _max_micros_elapsed(start_time, 0);
@@ -244,7 +503,7 @@ uint8_t __expected_hash[20];
     //     _handleSystemEvents();
     // } 
 
-    if (memcmp( __expected_hash, __hashArray, 20) == 0) {
+    if (memcmp( job.target, __hashArray, 20) == 0) {
         elapsed_time_us = micros() - start_time;
         nonce_found = counter;
         return true;
@@ -262,13 +521,22 @@ void MinerClient::_setState(DUINO_STATE state, int idx) {
 
   _clients[idx]._state = state;
   _clients[idx]._stateStartMS = (state == DUINO_STATE_NONE) ? 0 : millis();
+
+  // A new state gets its first look straight away, NONE never
+  if(state == DUINO_STATE_NONE) {
+    _schedule.cancel(idx);
+  }
+  else {
+    _schedule.schedule(idx, micros());
+  }
 }
 
 bool MinerClient::_isStateStuck(int idx) {
   assert(idx < _numMinerClients);
 
   if (_clients[idx]._state == DUINO_STATE_IDLE
-    || _clients[idx]._state == DUINO_STATE_NONE)
+    || _clients[idx]._state == DUINO_STATE_NONE
+    || _clients[idx]._state == DUINO_STATE_QUARANTINE)
   {
       return false;
   }
@@ -289,96 +557,53 @@ void static _printMinerPrefix(uint16_t address, bool isDebug) {
   }
 }
 
+// Only the bookkeeping happens here, on the miner's task. Printing and
+// the LED go through the EventBus so a slow serial port can't hold it up
 void MinerClient::_poolEventSink(PoolEvent ev, const PoolEventData& d, void *user) {
   ClientStruct* client = static_cast<ClientStruct*>(user);
+  EventBus& bus = EventBus::instance();
+
+  // Whatever it is, the lease holder should have a look
+  client->_miner->_wake(client - client->_miner->_clients);
 
   switch (ev)
   {
-  case POOLEVT_CONNECTED:
-    _printMinerPrefix(client->_address, true);
-    DEBUGPRINT_LN("POOLEVT_CONNECTED");
-    DEBUGPRINT_LN(d.text);
-    break;
-  case POOLEVT_DISCONNECTED:     // payload: text = reason
-    _printMinerPrefix(client->_address, true);
-    DEBUGPRINT_LN("POOLEVT_DISCONNECTED");
-    break;
-  case POOLEVT_MOTD:             // payload: text = motd
-    _printMinerPrefix(client->_address, true);
-    DEBUGPRINT_LN("POOLEVT_MOTD");
-    DEBUGPRINT_LN(d.text);
-    break;
-  case POOLEVT_JOB_REQUESTED:
-    _printMinerPrefix(client->_address, true);
-    DEBUGPRINT_LN("POOLEVT_REQUESTED");
-    break;
-  case POOLEVT_JOB_RECEIVED:     // payload: seed40 / target40 / diff
-    _printMinerPrefix(client->_address, true);
-    DEBUGPRINT_LN("POOLEVT_JOB_RECEIVED - ");
-    DEBUGPRINT(d.jobDataPtr->prevHash);
-    DEBUGPRINT(" | ");
-    DEBUGPRINT(d.jobDataPtr->expectedHash);
-    DEBUGPRINT(" | ");
-    DEBUGPRINT_LN(d.jobDataPtr->difficulty);
+  case POOLEVT_JOB_RECEIVED:     // a = diff, b = job id, text = seed
+    bus.publish(BUS_POOL, ev, client->_address, d.jobDataPtr->difficulty, d.jobDataPtr->id, 0, d.jobDataPtr->seedHex);
     break;
   case POOLEVT_RESULT_GOOD:
-    _printMinerPrefix(client->_address, true);
-    DEBUGPRINT_LN("Share accepted");
-    client->stats_good_count++;
-    if(client->_address == 0) {
-      blinkStatus(BLINK_SHARE_GOOD);
-    }
-    else {
-      blinkStatus(BLINK_SLAVE_SHARE_GOOD);
-    }
+    client->stats->good_count++;
+    client->work->pacer.onVerdict(true);
+    bus.publish(BUS_POOL, ev, client->_address);
     break;
-  case POOLEVT_RESULT_BAD:
-    _printMinerPrefix(client->_address, false);
-    SERIALPRINT("Share rejected: ");
-    SERIALPRINT(d.text ? d.text : "");
-    SERIALPRINT("  Diff: ");
-    SERIALPRINT(client->diff);
-    SERIALPRINT("  Last Nonce: ");
-    SERIALPRINT(client->lastNonce);
-    SERIALPRINT(".  Time: ");
-    SERIALPRINT( client->lastTimeTakenMs );
-    SERIALPRINT("ms");
-    SERIALPRINT("  HR: ");
-    SERIALPRINT(client->lastHashRate);
-    //SERIALPRINT( client->lastNonce / (client->lastTimeTakenMs * 0.001f) );
-    SERIALPRINT_LN("");
-
-    client->stats_bad_count++;
-    if( client->lastHashRate > client->highestHashWithError)
-      client->highestHashWithError = client->lastHashRate;
-    if( client->lastHashRate < client->lowestHashWithError)
-      client->lowestHashWithError = client->lastHashRate;
-
-    blinkStatus(BLINK_SHARE_ERROR);
+  case POOLEVT_RESULT_BAD:       // a = nonce, b = ms taken, c = diff, text = reason
+    client->stats->bad_count++;
+    client->work->pacer.onVerdict(false);
+    client->pendingRejects++;     // counted against its health on its next look
+    if( client->lastHashRate > client->stats->highestHashWithError)
+      client->stats->highestHashWithError = client->lastHashRate;
+    if( client->lastHashRate < client->stats->lowestHashWithError)
+      client->stats->lowestHashWithError = client->lastHashRate;
+    bus.publish(BUS_POOL, ev, client->_address, client->lastNonce, client->lastTimeTakenMs, client->work->job.difficulty, d.text);
     break;
   case POOLEVT_RESULT_BLOCK:
-    _printMinerPrefix(client->_address, true);
-    DEBUGPRINT_LN("Found a BLOCK ... Whoa!");
-    client->stats_block_count++;
-    blinkStatus(BLINK_SHARE_BLOCKFOUND);
-    break;
-  case POOLEVT_ERROR:
-    _printMinerPrefix(client->_address, false);
-    SERIALPRINT("POOLEVT_ERROR: ");
-    SERIALPRINT_LN(d.text);
+    client->stats->block_count++;
+    client->work->pacer.onVerdict(true);
+    bus.publish(BUS_POOL, ev, client->_address);
     break;
 
   default:
+    bus.publish(BUS_POOL, ev, client->_address, 0, 0, 0, d.text);
     break;
   }
 
 }
 
-bool MinerClient::_solveAndSubmit(const char *seed40, const char *target40, uint32_t diff) {
+bool MinerClient::_solveAndSubmit(const Job &job, uint32_t diff) {
   uint32_t found_nonce = 0;
   uint32_t elapsed_time = 0;
 
-  if( this->findNonce(seed40, target40, diff, found_nonce, elapsed_time) ) {
+  if( this->findNonce(job, diff, found_nonce, elapsed_time) ) {
     float elapsed_time_s = elapsed_time * .000001f;
     _masterLastHashedPerSec = (found_nonce / elapsed_time_s) * 1;
     _masterLastHashrateKhs = _masterLastHashedPerSec / 1000.0f;
@@ -393,7 +618,539 @@ bool MinerClient::_solveAndSubmit(const char *seed40, const char *target40, uint
   solved.hashrate_khs = _masterLastHashrateKhs;
   _emit(ME_SOLVED, solved);
 
-  return _clients[0]._pool->submitJob(found_nonce, elapsed_time);
+  _queueShare(0, found_nonce, elapsed_time);
+  return true;
+}
+
+/// @brief Hand each member of the group its slice of the leader's job
+void MinerClient::_dispatchGroupJob(int leaderIdx) {
+  auto& leader = _clients[leaderIdx];
+  const uint32_t total = leader.work->job.difficulty * 100 + 1;
+  const uint8_t diffByte = (leader.work->job.difficulty > 255) ? 255 : (uint8_t)leader.work->job.difficulty;
+
+  leader.groupPending = 0;
+  leader._jobStartTime = millis();
+  bool leaderMining = false;
+
+  // Quarantined members sit out, the others split the whole range
+  uint8_t active = 0;
+  for(uint8_t m = 0; m < leader.groupSize; m++) {
+    if(!_isQuarantined(leaderIdx + m)) active++;
+  }
+  if(active == 0) {
+    _releasePool(leaderIdx);
+    _setState(DUINO_STATE_QUARANTINE, leaderIdx);
+    return;
+  }
+
+  for(uint8_t m = 0, slice = 0; m < leader.groupSize; m++) {
+    const int idx = leaderIdx + m;
+    auto& member = _clients[idx];
+    if(_isQuarantined(idx)) continue;
+    const uint32_t rangeStart = (uint64_t)total * slice / active;
+    const uint32_t rangeEnd = (uint64_t)total * (slice + 1) / active;
+    slice++;
+
+    if(_i2c->sendJobData(member._address, leader.work->job, diffByte, rangeStart, rangeEnd)) {
+      member._jobStartTime = leader._jobStartTime;
+      member.verifyFailures = 0;
+      _startProgress(idx, rangeStart, rangeEnd);
+      _setState(DUINO_STATE_MINING_I2C, idx);
+      leader.groupPending++;
+      if(idx == leaderIdx) leaderMining = true;
+    }
+    else {
+      _healthEvent(idx, HEALTH_BAD_RESULT);
+    }
+  }
+
+  if(leader.groupPending == 0) {
+    _dropJob(leaderIdx);    // nobody took it, the pool still waits on it
+  }
+  else if(!leaderMining) {
+    _setState(DUINO_STATE_GROUP_WAIT, leaderIdx);
+  }
+}
+
+/// @brief A group member finished its slice. The first one with a nonce wins
+/// and the rest are preempted.
+void MinerClient::_groupMemberDone(int idx, uint32_t foundNonce) {
+  const int leaderIdx = _clients[idx].groupLeader;
+  auto& leader = _clients[leaderIdx];
+
+  if(idx != leaderIdx) {
+    _setState(DUINO_STATE_NONE, idx);
+  }
+  if(leader.groupPending > 0) {
+    leader.groupPending--;
+  }
+
+  if(foundNonce != 0) {
+    _abortGroup(leaderIdx, idx);
+
+    uint32_t masterTimeTakenMs = millis() - leader._jobStartTime;
+    DEBUGPRINT("[MINER_CLIENT] group member 0x");
+    DEBUGPRINT_HEX(_clients[idx]._address);
+    DEBUGPRINT(" solved hash in ");
+    DEBUGPRINT_LN(masterTimeTakenMs);
+
+    leader.stats->share_count++;
+    leader.lastNonce = foundNonce;
+    leader.lastTimeTakenMs = masterTimeTakenMs;
+    leader.lastHashRate = foundNonce / (masterTimeTakenMs * 0.001f);
+
+    _queueShare(leaderIdx, foundNonce, masterTimeTakenMs * 1000);
+  }
+  else if(leader.groupPending == 0) {
+    // Whole range searched without a hit, the pool won't hear about this one
+    _dropJob(leaderIdx);
+  }
+  else if(idx == leaderIdx) {
+    _setState(DUINO_STATE_GROUP_WAIT, leaderIdx);
+  }
+}
+
+/// @brief Preempt every member of the group still searching
+void MinerClient::_abortGroup(int leaderIdx, int exceptIdx) {
+  auto& leader = _clients[leaderIdx];
+  for(uint8_t m = 0; m < leader.groupSize; m++) {
+    const int idx = leaderIdx + m;
+    if(idx == exceptIdx || _clients[idx]._state != DUINO_STATE_MINING_I2C) continue;
+    _abortSlaveJob(idx);
+    if(idx != leaderIdx) {
+      _setState(DUINO_STATE_NONE, idx);
+    }
+  }
+  leader.groupPending = 0;
+}
+
+void MinerClient::_abortSlaveJob(int idx) {
+  auto& client = _clients[idx];
+  if(_i2c == nullptr || client._state != DUINO_STATE_MINING_I2C) return;
+
+  const uint32_t lostMs = millis() - client._jobStartTime;
+  client.stats->abort_count++;
+  client.stats->abandoned_ms += lostMs;
+
+  // The text protocol has no abort, the driver throws the late result away
+  if(client.legacy != nullptr) {
+    client.legacy->reset();
+    return;
+  }
+
+  if(!_i2c->abortJob(client._address)) {
+    // Not fatal, the next sendDataBegin() will tell us if it's still busy
+    _printMinerPrefix(client._address, false);
+    SERIALPRINT_LN("slave not ready after abort");
+  }
+  else {
+    _printMinerPrefix(client._address, true);
+    DEBUGPRINT("aborted job after ");
+    DEBUGPRINT(lostMs);
+    DEBUGPRINT_LN("ms");
+  }
+}
+
+/// @brief Submit a nonce a single (non group) slave found and start over
+void MinerClient::_submitSlaveResult(int idx, uint32_t foundNonce) {
+  auto& client = _clients[idx];
+  uint32_t masterTimeTakenMs = millis() - client._jobStartTime;
+  DEBUGPRINT("[MINER_CLIENT] Master time estimate: ");
+  DEBUGPRINT_LN(masterTimeTakenMs);
+
+  // Update stats
+  client.stats->share_count++;
+  client.lastNonce = foundNonce;
+  client.lastTimeTakenMs = masterTimeTakenMs;
+  client.lastHashRate = foundNonce / (masterTimeTakenMs * 0.001f);
+
+  _queueShare(idx, foundNonce, masterTimeTakenMs * 1000);
+}
+
+bool MinerClient::_verifyNonce(const Job &job, uint32_t nonce) {
+  char digits[11];
+  const int len = snprintf(digits, sizeof(digits), "%u", (unsigned)nonce);
+  uint8_t hash[20];
+
+  _dsha1->reset()
+    .write((const unsigned char *)job.seedHex, 40)
+    .write((const unsigned char *)digits, len)
+    .finalize(hash);
+  return memcmp(job.target, hash, 20) == 0;
+}
+
+/// @brief Check a slave's nonce before it goes to the pool. A bit flipped
+/// on the bus or a result for an old job would only come back rejected
+bool MinerClient::_checkSlaveResult(int idx, uint32_t foundNonce) {
+  auto& client = _clients[idx];
+  if(_verifyNonce(_clients[client.groupLeader].work->job, foundNonce)) {
+    client.verifyFailures = 0;
+    _healthEvent(idx, HEALTH_OK);
+    return true;
+  }
+
+  client.verifyFailures++;
+  _printMinerPrefix(client._address, false);
+  SERIALPRINT("result failed verification, nonce ");
+  SERIALPRINT_LN(foundNonce);
+  return false;
+}
+
+/// @brief Move a stock firmware slave's transfer along
+void MinerClient::_pollLegacy(int idx) {
+  auto& client = _clients[idx];
+
+  switch(client.legacy->poll()) {
+    case WireWrapSlave::WW_DONE: {
+      uint32_t nonce = 0;
+      uint32_t elapsedUs = 0;
+      client.legacy->getResult(nonce, elapsedUs);
+      if(nonce == 0) {
+        _dropJob(idx);    // finished, nothing to abort
+        break;
+      }
+      if(!_checkSlaveResult(idx, nonce)) {
+        // The driver only hands a result out once, get a new job
+        client.stats->local_reject_count++;
+        if(!_healthEvent(idx, HEALTH_BAD_RESULT)) {
+          _dropJob(idx);
+        }
+        break;
+      }
+      DEBUGPRINT("[MINER_CLIENT] legacy slave solved hash in ");
+      DEBUGPRINT(elapsedUs / 1000);
+      DEBUGPRINT_LN("ms.");
+      _submitSlaveResult(idx, nonce);
+      break;
+    }
+
+    case WireWrapSlave::WW_ERROR:
+      _printMinerPrefix(client._address, false);
+      SERIALPRINT_LN("legacy slave transfer failed, new job");
+      client.legacy->reset();
+      if(!_healthEvent(idx, HEALTH_BAD_RESULT)) {
+        _dropJob(idx);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void MinerClient::_resetWorker(int idx) {
+  const int leaderIdx = _clients[idx].groupLeader;
+  if(_clients[leaderIdx].groupSize > 1) {
+    _abortGroup(leaderIdx);
+    _dropJob(leaderIdx);
+  }
+  else {
+    _abortSlaveJob(idx);
+    _dropJob(idx);
+  }
+}
+
+/// @brief The pool only takes this job's result next, so a job that can't
+/// be finished takes the connection with it, then queue for a fresh one
+void MinerClient::_dropJob(int idx) {
+  _releasePool(idx);
+  _setState(DUINO_STATE_IDLE, idx);
+}
+
+/// @brief Worker state for count workers, once they're known. Only ever
+/// grows, the scheduler and pool manager hold on to the indexes. From the
+/// boot arena, a table that's outgrown stays there unused
+void MinerClient::_allocClients(uint8_t count) {
+  if(count == 0) count = 1;     // index 0 is always safe to look at
+  if(_clients != nullptr && count <= _numAllocated) return;
+
+  _clients = BootArena::instance().makeArray<ClientStruct>(count);
+  _stats = BootArena::instance().makeArray<WorkerStats>(count);
+  _work = BootArena::instance().makeArray<WorkerJob>(count);
+  _numAllocated = count;
+  for(uint8_t c = 0; c < count; c++) {
+    _clients[c]._miner = this;
+    _clients[c].stats = &_stats[c];
+    _clients[c].work = &_work[c];
+  }
+}
+
+/// @brief Queue for the worker's pool connection, true once it holds a
+/// connected one
+bool MinerClient::_acquirePool(int idx) {
+  auto& client = _clients[idx];
+  if(_pools == nullptr || client.poolSlot < 0) return false;
+
+  Pool* pool = _pools->acquire(client.poolSlot);
+  if(pool == nullptr || !pool->isConnected()) return false;
+
+  client._pool = pool;
+  client.jobOutstanding = false;
+  client.leaseSubmitted = false;
+  return true;
+}
+
+/// @brief Give the connection back. The pool expects the result of a job
+/// before anything else, so a job dropped mid way takes the socket with it
+void MinerClient::_releasePool(int idx) {
+  auto& client = _clients[idx];
+  if(_pools == nullptr || client.poolSlot < 0) return;
+
+  if(client._pool != nullptr && (client.jobOutstanding || !client._pool->isIdle())) {
+    client._pool->disconnect();
+  }
+  _pools->release(client.poolSlot);
+  client._pool = nullptr;
+  client.jobOutstanding = false;
+  client.leaseSubmitted = false;
+
+  // Whoever is next on the connection can go now
+  const int16_t nextSlot = _pools->getOwner(_pools->getConnectionOf(client.poolSlot));
+  for(uint8_t c = 0; nextSlot >= 0 && c < _numMinerClients; c++) {
+    if(_clients[c].poolSlot == nextSlot) {
+      _wake(c);
+      break;
+    }
+  }
+}
+
+/// @brief When to next ask a slave for its result. The nonce is anywhere in
+/// the slice, so the slave is done by the time it gets to the end of it:
+/// spread a few polls over the predicted time, land one on the predicted
+/// end and keep close once it's overdue
+uint32_t MinerClient::_statusPollMs(int idx) {
+  auto& client = _clients[idx];
+  if(client.estHashRate <= 0) {
+    return POLL_SLAVE_STATUS_MS;    // nothing learned yet
+  }
+
+  const uint32_t now = millis();
+  uint32_t endMs = client.estimatedFinishMs;   // from the slave's progress, when known
+  if(endMs == 0) {
+    const uint32_t span = client.rangeEnd - client.rangeStart;
+    endMs = client._jobStartTime + (uint32_t)(span / client.estHashRate * 1000.0f);
+  }
+  if((int32_t)(endMs - now) <= 0) {
+    return POLL_SLAVE_MIN_MS;
+  }
+
+  const uint32_t jobMs = endMs - client._jobStartTime;
+  const uint32_t interval = constrain(jobMs / POLL_SLAVE_PER_JOB, (uint32_t)POLL_SLAVE_MIN_MS, (uint32_t)POLL_SLAVE_MAX_MS);
+  return min(interval, endMs - now);
+}
+
+/// @brief A slave's result was collected. Learn its hash rate and how long
+/// the result sat there before we asked
+void MinerClient::_notePickup(int idx, uint32_t hashes, uint16_t slaveMs) {
+  auto& client = _clients[idx];
+  const uint32_t masterMs = millis() - client._jobStartTime;
+
+  if(slaveMs > 0 && hashes > 0) {
+    const float rate = hashes * 1000.0f / slaveMs;
+    client.estHashRate = (client.estHashRate <= 0) ? rate : client.estHashRate * 0.75f + rate * 0.25f;
+  }
+  // Includes the job transfer, close enough to compare polling schemes
+  if(masterMs > slaveMs) {
+    client.stats->pickup_ms += masterMs - slaveMs;
+  }
+  client.stats->pickup_count++;
+}
+
+/// @brief Move the worker's health score. Returns true if that put it in
+/// quarantine and took it off its state machine, group members only sit
+/// out their leader's jobs and carry on as they were
+bool MinerClient::_healthEvent(int idx, HEALTH_EVENT ev) {
+  auto& client = _clients[idx];
+  if(_isMasterMiner) return false;      // nothing to swap it out for
+
+  switch(ev) {
+    case HEALTH_OK:
+      client.health += (1.0f - client.health) * 0.1f;
+      if(client.health >= HEALTH_RECOVERED) client.quarantines = 0;
+      return false;
+    case HEALTH_TIMEOUT:    client.health -= HEALTH_PENALTY_TIMEOUT; break;
+    case HEALTH_BAD_RESULT: client.health -= HEALTH_PENALTY_RESULT; break;
+    case HEALTH_REJECTED:   client.health -= HEALTH_PENALTY_REJECT; break;
+  }
+  if(client.health < 0) client.health = 0;
+  client.stats->fault_count++;
+  if(client.health >= HEALTH_QUARANTINE || client.quarantineUntilMs != 0) return false;
+
+  const uint32_t backoffMs = QUARANTINE_BASE_MS << min(client.quarantines, (uint8_t)QUARANTINE_MAX_SHIFT);
+  client.quarantines++;
+  client.stats->quarantine_count++;
+  client.quarantineUntilMs = (millis() + backoffMs) | 1;    // 0 means not quarantined
+  _printMinerPrefix(client._address, false);
+  SERIALPRINT("unhealthy, quarantined for ");
+  SERIALPRINT(backoffMs / 1000);
+  SERIALPRINT_LN("s");
+
+  if(_clients[client.groupLeader].groupSize > 1) return false;
+
+  _abortSlaveJob(idx);
+  _releasePool(idx);
+  _setState(DUINO_STATE_QUARANTINE, idx);
+  return true;
+}
+
+/// @brief Still sitting out. Once the time is up the worker is back on
+/// probation
+bool MinerClient::_isQuarantined(int idx) {
+  auto& client = _clients[idx];
+  if(client.quarantineUntilMs == 0) return false;
+  if((int32_t)(millis() - client.quarantineUntilMs) < 0) return true;
+
+  client.quarantineUntilMs = 0;
+  client.health = HEALTH_PROBATION;
+  _printMinerPrefix(client._address, true);
+  DEBUGPRINT_LN("back from quarantine");
+  return false;
+}
+
+/// @brief Well past the time the slave should need for its slice
+bool MinerClient::_isOverdue(int idx) {
+  auto& client = _clients[idx];
+  if(client.estHashRate <= 0) return false;     // no idea how long it should take
+
+  const uint32_t jobMs = (uint32_t)((client.rangeEnd - client.rangeStart) / client.estHashRate * 1000.0f);
+  return millis() - client._jobStartTime > jobMs * JOB_OVERDUE_FACTOR + JOB_OVERDUE_GRACE_MS;
+}
+
+void MinerClient::_runIn(int idx, uint32_t ms) {
+  _schedule.schedule(idx, micros() + ms * 1000UL);
+}
+
+/// @brief Something the worker may be waiting on happened, look at it on
+/// the next pass rather than at its next poll
+void MinerClient::_wake(int idx) {
+  if(_clients[idx]._state == DUINO_STATE_NONE) return;
+  _schedule.scheduleBy(idx, micros());
+}
+
+/// @brief Look at the worker again after its state's poll interval. A
+/// stock slave's job and result go a char per poll, at the driver's pace
+void MinerClient::_scheduleNext(int idx) {
+  auto& client = _clients[idx];
+  if(client._state == DUINO_STATE_MINING_I2C && client.legacy != nullptr) {
+    _schedule.schedule(idx, client.legacy->nextStepUs());
+    return;
+  }
+  _runIn(idx, _pollIntervalMs(idx));
+}
+
+uint32_t MinerClient::_pollIntervalMs(int idx) {
+  switch(_clients[idx]._state) {
+    case DUINO_STATE_IDLE:        return POLL_IDLE_MS;
+    case DUINO_STATE_JOB_REQUEST: return POLL_JOB_REQ_MS;
+    case DUINO_STATE_JOB_WAIT:    return POLL_JOB_WAIT_MS;
+    case DUINO_STATE_MINING_I2C:  return _statusPollMs(idx);
+    case DUINO_STATE_GROUP_WAIT:  return POLL_GROUP_WAIT_MS;
+    default:                      return 0;
+  }
+}
+
+void MinerClient::_runCommands() {
+  MinerCommand cmd;
+  while(_commands.pop(cmd)) {
+    switch(cmd) {
+      case MC_START_MINING: setMining(true); break;
+      case MC_STOP_MINING:  setMining(false); break;
+      case MC_SHUTDOWN:     shutdown(); break;
+    }
+  }
+}
+
+/// @brief Send the share. When pipelining, the next job request goes with
+/// it unless another worker is waiting for the connection
+bool MinerClient::_submitShare(int idx, uint32_t foundNonce, uint32_t elapsedUs) {
+  auto& client = _clients[idx];
+  client.leaseSubmitted = true;
+
+  if(client._pool->isPipelining() && !_pools->hasWaiters(client.poolSlot)) {
+    client.jobOutstanding = client._pool->submitJobAndRequest(foundNonce, elapsedUs);
+    return client.jobOutstanding;
+  }
+
+  client.jobOutstanding = false;
+  return client._pool->submitJob(foundNonce, elapsedUs);
+}
+
+/// @brief Send the share, or if the pool has been rejecting shares this
+/// quick off the job, hold it until the pacer's job age
+void MinerClient::_queueShare(int idx, uint32_t foundNonce, uint32_t elapsedUs) {
+  auto& client = _clients[idx];
+  client.heldNonce = foundNonce;
+  client.heldElapsedUs = elapsedUs;
+  client.holdUntilMs = client._jobStartTime + (SHARE_PACING ? client.work->pacer.holdMs() : 0);
+
+  if((int32_t)(millis() - client.holdUntilMs) < 0) {
+    client.stats->held_count++;
+    _setState(DUINO_STATE_SHARE_HOLD, idx);
+    return;
+  }
+  _releaseShare(idx);
+}
+
+void MinerClient::_releaseShare(int idx) {
+  auto& client = _clients[idx];
+  const uint32_t jobAgeMs = millis() - client._jobStartTime;
+  // Report the time the pool saw the job out for, hold included
+  const uint32_t elapsedUs = max(client.heldElapsedUs, jobAgeMs * 1000);
+
+  client.work->pacer.onSubmit(jobAgeMs);
+  _submitShare(idx, client.heldNonce, elapsedUs);
+  _setState(DUINO_STATE_SHARE_SUBMITTED, idx);  // start again
+}
+
+void MinerClient::_startProgress(int idx, uint32_t rangeStart, uint32_t rangeEnd) {
+  auto& client = _clients[idx];
+  client.rangeStart = rangeStart;
+  client.rangeEnd = rangeEnd;
+  client.progressNonce = rangeStart;
+  client.progressAdvanceMs = millis();
+  client.estimatedFinishMs = 0;
+  client.nextProgressUs = micros() + POLL_SLAVE_PROGRESS_MS * 1000UL;
+}
+
+/// @brief Ask the slave how far it has got. Gives a live hash rate, an
+/// estimate of when the slice will be exhausted and catches a slave whose
+/// counter stopped long before the stuck state timeout would.
+bool MinerClient::_updateProgress(int idx) {
+  auto& client = _clients[idx];
+  uint32_t nonce = 0;
+  uint32_t elapsedMs = 0;
+  bool done = false;
+
+  // Older slave firmware doesn't know the command, the status polls still work
+  if(!_i2c->getJobProgress(client._address, nonce, elapsedMs, done)) return true;
+  if(done) return true;     // the status poll collects the result
+
+  const uint32_t now = millis();
+  if(nonce != client.progressNonce) {
+    client.progressNonce = nonce;
+    client.progressAdvanceMs = now;
+  }
+  else if(now - client.progressAdvanceMs > SLAVE_STALL_TIMEOUT) {
+    client.stats->stall_count++;
+    _printMinerPrefix(client._address, false);
+    SERIALPRINT("stalled at nonce ");
+    SERIALPRINT(nonce);
+    SERIALPRINT_LN(", resetting");
+    if(!_healthEvent(idx, HEALTH_TIMEOUT)) {
+      _resetWorker(idx);
+    }
+    return false;
+  }
+
+  if(elapsedMs > 0 && nonce > client.rangeStart) {
+    client.liveHashRate = (nonce - client.rangeStart) / (elapsedMs * 0.001f);
+    const uint32_t left = (client.rangeEnd > nonce) ? client.rangeEnd - nonce : 0;
+    client.estimatedFinishMs = now + (uint32_t)(left / client.liveHashRate * 1000.0f);
+  }
+
+  // We've just heard it is still searching, no need to ask for the status yet
+  _runIn(idx, _statusPollMs(idx));
+  return true;
 }
 
 bool MinerClient::_max_micros_elapsed(unsigned long current, unsigned long max_elapsed) {
@@ -414,46 +1171,83 @@ void MinerClient::_handleSystemEvents() {
 }
 
 void MinerClient::_printReport() {
-  char buf[64];
+  char buf[128];
   u_int32_t
     total_share_count=0,
     total_good_count=0,
     total_bad_count=0,
-    total_block_count=0;
+    total_block_count=0,
+    total_abort_count=0,
+    total_local_reject_count=0,
+    total_fault_count=0,
+    total_quarantine_count=0,
+    total_status_polls=0,
+    total_pickup_ms=0,
+    total_pickup_count=0,
+    total_abandoned_ms=0;
 
   SERIALPRINT_LN(F("************ REPORT ************"));
-  SERIALPRINT("FreeRam: ");
-  SERIALPRINT_LN(ESP.getFreeHeap());
-
-  SERIALPRINT_LN(F("Addr     Count     Good      Bad  Block   Uptime  Shrs/min"));
-  for(int c=0; c < _numMinerClients; c++) {
-    auto const client = _clients[c];
-
-    total_share_count += client.stats_share_count;
-    total_good_count += client.stats_good_count;
-    total_bad_count += client.stats_bad_count;
-    total_block_count += client.stats_block_count;
+  // Free heap alone hides fragmentation, the largest block is what the
+  // next connect has to fit in
+  HeapStats::Snapshot heap;
+  HeapStats::instance().snapshot(heap);
+  snprintf(buf, sizeof(buf), "FreeRam: %u  Largest block: %u (%u%% fragmented)  Min ever: %u",
+    heap.freeBytes, heap.largestBlock,
+    heap.freeBytes ? 100 - (unsigned)(100ULL * heap.largestBlock / heap.freeBytes) : 0,
+    heap.minFreeEver);
+  SERIALPRINT_LN(buf);
 
-    uint32_t uptimeSecs = (millis() - client.startTimeMs) / 1000;
-    float sharesPerMin = (float)client.stats_good_count / ((uptimeSecs<1) ? 1 : (uptimeSecs / 60));
+  if(_i2c != nullptr) {
+    const I2CMaster::I2C_BUS_STATS& bus = _i2c->getBusStats();
+    snprintf(buf, sizeof(buf), "I2C bus recoveries: %u (failed %u) last: %ums %uus",
+      bus.recoveries, bus.failedRecoveries,
+      bus.lastRecoveryMs, bus.lastRecoveryUs);
+    SERIALPRINT_LN(buf);
+  }
 
-    snprintf(buf, 64, "%#x  %8u %8u %8u %6u %5u:%02d %7.3f",
+  SERIALPRINT_LN(F("Addr     Count     Good      Bad  Block   Uptime  Shrs/min     H/s Stall  Held  Hold Health"));
+  for(int c=0; c < _numMinerClients; c++) {
+    const auto& client = _clients[c];
+
+    total_share_count += client.stats->share_count;
+    total_good_count += client.stats->good_count;
+    total_bad_count += client.stats->bad_count;
+    total_block_count += client.stats->block_count;
+    total_abort_count += client.stats->abort_count;
+    total_local_reject_count += client.stats->local_reject_count;
+    total_fault_count += client.stats->fault_count;
+    total_quarantine_count += client.stats->quarantine_count;
+    total_status_polls += client.stats->status_polls;
+    total_pickup_ms += client.stats->pickup_ms;
+    total_pickup_count += client.stats->pickup_count;
+    total_abandoned_ms += client.stats->abandoned_ms;
+
+    uint32_t uptimeSecs = (millis() - client.stats->startTimeMs) / 1000;
+    float sharesPerMin = (float)client.stats->good_count / ((uptimeSecs<1) ? 1 : (uptimeSecs / 60));
+
+    snprintf(buf, sizeof(buf), "%#x  %8u %8u %8u %6u %5u:%02d %7.3f %7.1f %5u %5u %5u %5.2f%c",
     client._address,
-    client.stats_share_count,
-    client.stats_good_count,
-    client.stats_bad_count,
-    client.stats_block_count,
+    client.stats->share_count,
+    client.stats->good_count,
+    client.stats->bad_count,
+    client.stats->block_count,
     uptimeSecs/60,
     uptimeSecs%60,
-    sharesPerMin
+    sharesPerMin,
+    client.liveHashRate,
+    client.stats->stall_count,
+    client.stats->held_count,
+    client.work->pacer.holdMs(),
+    client.health,
+    client.quarantineUntilMs ? 'Q' : ' '
     );
     SERIALPRINT_LN(buf);
 
     // SERIALPRINT("Highest / Lowest Error hash rates...   ");
     // SERIALPRINT("Highest: ");
-    // SERIALPRINT(client.highestHashWithError);
+    // SERIALPRINT(client.stats->highestHashWithError);
     // SERIALPRINT("  Lowest: ");
-    // SERIALPRINT_LN(client.lowestHashWithError);
+    // SERIALPRINT_LN(client.stats->lowestHashWithError);
   }
 
   snprintf(buf, 64, "Total %8u %8u %8u %6u",
@@ -461,5 +1255,49 @@ void MinerClient::_printReport() {
     total_bad_count, total_block_count);
   SERIALPRINT_LN(buf);
 
+  snprintf(buf, sizeof(buf), "Aborted jobs: %u  Abandoned hashing: %u.%03us  Local rejects: %u",
+    total_abort_count, total_abandoned_ms / 1000, total_abandoned_ms % 1000,
+    total_local_reject_count);
+  SERIALPRINT_LN(buf);
+
+  snprintf(buf, sizeof(buf), "Worker faults: %u  Quarantines: %u",
+    total_fault_count, total_quarantine_count);
+  SERIALPRINT_LN(buf);
+
+  if(total_pickup_count > 0) {
+    snprintf(buf, sizeof(buf), "Slave status polls per result: %.1f  Result pickup delay: %ums avg",
+      (float)total_status_polls / total_pickup_count, total_pickup_ms / total_pickup_count);
+    SERIALPRINT_LN(buf);
+  }
+
+  PoolDiscovery& disc = PoolDiscovery::instance();
+  snprintf(buf, sizeof(buf), "Pool discovery: lookups %u (failed %u) age %us",
+    disc.getFetchCount(), disc.getFailCount(), disc.getAgeMs() / 1000);
+  SERIALPRINT_LN(buf);
+  for(uint8_t n = 0; n < disc.getNodeCount(); n++) {
+    POOL_NODE_STATS node;
+    if(!disc.getNode(n, node)) continue;
+    snprintf(buf, sizeof(buf), "  %s:%u conn %ums job %ums err %.2f use %u good %u bad %u%s",
+      node.ep.host, node.ep.port, node.connectRttMs, node.jobRttMs, node.errorRate,
+      node.activeConns, node.sharesGood, node.sharesBad, node.downUntilMs ? " DOWN" : "");
+    SERIALPRINT_LN(buf);
+  }
+
+  if(_pools != nullptr) {
+    for(uint8_t p = 0; p < _pools->getConnectionCount(); p++) {
+      const int16_t owner = _pools->getOwner(p);
+      snprintf(buf, sizeof(buf), "Pool conn %u: queued %u  owner %d  leases %u",
+        p, _pools->getQueueDepth(p), owner, _pools->getLeaseCount(p));
+      SERIALPRINT_LN(buf);
+    }
+  }
+
+  // What each worker costs, the pool connections are shared
+  snprintf(buf, sizeof(buf), "Worker RAM: %u x %u bytes (state %u + job %u + stats %u + pool mgr %u)  Pool conns: %u x %u bytes",
+    _numMinerClients, (unsigned)(sizeof(ClientStruct) + sizeof(WorkerJob) + sizeof(WorkerStats) + PoolManager::workerBytes()),
+    (unsigned)sizeof(ClientStruct), (unsigned)sizeof(WorkerJob), (unsigned)sizeof(WorkerStats), (unsigned)PoolManager::workerBytes(),
+    _pools ? _pools->getConnectionCount() : 0, (unsigned)sizeof(Pool));
+  SERIALPRINT_LN(buf);
+
   SERIALPRINT_LN("");
 }
@@ -2,11 +2,10 @@
 #include <ArduinoOTA.h>
 #include <WiFi.h>
 #include <ESPmDNS.h>
-#include <WiFiClientSecure.h>
-#include <HTTPClient.h>
 
 #include "config.h"
 #include "network_services.h"
+#include "httpService.h"
 
 void wifi_setup() {
   SERIALPRINT_LN("[WIFI] Connecting to: " + String(WIFI_SSID));
@@ -53,9 +52,13 @@ void mdns_setup() {
                 + ")\n");
 }
 
-void ota_setup() {
+static void (*_otaStartCb)() = nullptr;
+
+void ota_setup(void (*onStart)()) {
+  _otaStartCb = onStart;
   ArduinoOTA.onStart([]() { // Prepare OTA stuff
     SERIALPRINT_LN("[OTA] Start");
+    if (_otaStartCb) _otaStartCb();
   });
   ArduinoOTA.onEnd([]() {
     SERIALPRINT_LN("[OTA] End");
@@ -81,25 +84,11 @@ void ota_setup() {
   ArduinoOTA.begin();
 }
 
+// Blocking, goes through the http service so the connection is reused.
+// Prefer HttpService::get() from the main loop
 String http_get_string(String URL)
 {
   String payload = "";
-  WiFiClientSecure client;
-  client.setInsecure();
-  HTTPClient http;
-  if (http.begin(client, URL))
-  {
-    int httpCode = http.GET();
-    if (httpCode == HTTP_CODE_OK)
-    {
-      payload = http.getString();
-    }
-    else
-    {
-      SERIALPRINT_LN("[HTTP] GET... failed, error: ");
-      SERIALPRINT_LN(http.errorToString(httpCode).c_str());
-    }
-    http.end();
-  }
+  HttpService::instance().fetch(URL, payload);
   return payload;
 }
@@ -1,16 +1,23 @@
 #include "config.h"
 #include "pool.h"
+#include "poolDiscovery.h"
+#include "httpService.h"
 #include "network_services.h"
 #include "utils.h"
+#include "heapStats.h"
 
 #include <Arduino.h>
-#include <WiFiClient.h>
 #include <ArduinoJson.h>
+#include <strings.h>
+#include <atomic>
 
 #define CLIENT_TIMEOUT_CONNECTION 30000
 #define CLIENT_TIMEOUT_RW         5000UL
 #define STATE_STUCK_TIMEOUT       30000UL
 
+// A share line: the submit tail plus the nonce and hashrate in front
+#define POOL_SUBMIT_MAX  (POOL_LINE_MAX + 32)
+
 #define END_TOKEN  '\n'
 #define SEP_TOKEN  ','
 
@@ -21,29 +28,41 @@
 #define GOOD "GOOD"
 #define BLOCK "BLOCK"
 
-const char * urlPool = "https://server.duinocoin.com/getPool";
+// Job ids, unique across all pools, which may be on different tasks
+static std::atomic<uint32_t> _jobCounter(0);
+
 const char * urlMiningKeyStatus = "https://server.duinocoin.com/mining_key";
 
 Pool::Pool(String username, String miningKey, DeviceType type) {
   _username = username;
   _miningKey = miningKey;
-  _type = type;
   _workerId = String(getChipId());  // default
+  setDeviceType(type);
+}
+
+void Pool::setDeviceType(DeviceType type) {
+  _type = type;
 
   switch (type) {
     case DEVICE_SLAVE:
     case DEVICE_AVR:
       _startingDifficulty = AVR_WORKER_JOB;
-      _appName = String(APP_NAME_SLAVE) + String(APP_VERSION);
+      _appName = APP_NAME_SLAVE APP_VERSION;
+      break;
+    case DEVICE_AVR_GROUP:
+      _startingDifficulty = I2C_GROUP_START_DIFF;
+      _appName = APP_NAME_SLAVE APP_VERSION;
       break;
     case DEVICE_ESP32:
       _startingDifficulty = ESP_WORKER_JOB;
-  _appName = String(APP_NAME_MASTER) + String(APP_VERSION);
+      _appName = APP_NAME_MASTER APP_VERSION;
       break;
     default:
       DEBUGPRINT_LN("[POOL] ctor no device type specified");
       break;
   }
+  _buildJobLine();
+  _buildSubmitTail();
 }
 
 // ----------------------------------------------------------------------------
@@ -91,22 +110,30 @@ bool Pool::isConnected() {
   return _client.connected() && _poolConnectTime > 0;
 }
 
+bool Pool::isIdle() {
+  return _state == POOL_STATE_IDLE;
+}
+
 void Pool::setUsername(String un) {
   _username = un;
+  _buildJobLine();
 }
 
-void Pool::setMinerName(String minerName) {
-  _minerName = minerName.isEmpty() ? "None" : minerName;
+void Pool::setMinerName(const char *minerName) {
+  _minerName = (minerName == nullptr || *minerName == '\0') ? "None" : minerName;
+  _buildSubmitTail();
 }
 
 void Pool::setWorkerId(String workerId) {
   _workerId = workerId.isEmpty() || workerId == "Auto" ? String(getChipId()) : workerId;
   DEBUGPRINT_LN("[POOL] setting worker id; " + _workerId);
+  _buildSubmitTail();
 }
 
 void Pool::setMiningKey(String newMiningKey) {
     _miningKey = newMiningKey;
     DEBUGPRINT_LN("[POOL] Setting mining_key: " + _miningKey);
+    _buildJobLine();
 }
 
 /// ******* SETUP POOL ********
@@ -121,8 +148,7 @@ void Pool::loop() {
   if(_isStateStuck()) {
     // This might not be because of a disconnect, handle better
     _poolConnectTime = 0;
-    _host = "";
-    _port = 0;    // clear the pool, start again
+    _releaseNode();    // clear the pool, start again
     if (_client.connected()) {
       _client.stop();
     }
@@ -137,93 +163,63 @@ void Pool::loop() {
       connect();
     }
     break;
-  
+
   case POOL_STATE_VERSION_WAIT:
-    if(_client.available()) {
-      _poolVersion = _client.readStringUntil(END_TOKEN);
-
-      _setState(POOL_STATE_IDLE);
-      _poolConnectTime = millis();
-
-      DEBUGPRINT("[POOL] connected ... ");
-      DEBUGPRINT_LN(_minerName);
-
-      // Only send the connected event once we have a server reply with the version
-      char buf[128];
-      snprintf(buf, sizeof(buf), "%s [%s:%d] Ver: %s",
-        _name.c_str(),
-        _host.c_str(),
-        _port,
-        _poolVersion.c_str());
-      _emit_text(POOLEVT_CONNECTED, buf);
-    }
+    _greet();
+    break;
 
   case POOL_STATE_MOTD_WAIT:
-    if(_client.available()) {
-      _MOTD = _client.readString();
-      _setState(POOL_STATE_IDLE);
-      _emit_text(POOLEVT_MOTD, _MOTD.c_str());
-    }
+    _readMotd();
     break;
 
   case POOL_STATE_JOB_WAIT:
-    if(_client.available()) {
-    String seed, target; uint16_t diff = 0;
-    if (_recvJobTriplet(seed, target, diff)) {
-      _poolJob.difficulty = diff;
-      _poolJob.expectedHash = target;
-      _poolJob.prevHash = seed;
-
-      _setState(POOL_STATE_SHARE_WAIT);
-
-      PoolEventData ed;
-      ed.jobDataPtr = &_poolJob;
-      _emit(POOLEVT_JOB_RECEIVED, ed);
-    }
-    else if (millis() - _stateStartMS > 5000UL) {
-      _last_err = F("JOB recv timeout");
-      _emit_text(POOLEVT_ERROR, _last_err.c_str());
-    }
-  }
+  case POOL_STATE_SUBMITTED:
+    _exchange();
     break;
 
-  case POOL_STATE_SHARE_WAIT:
-    // No-op
+  case POOL_STATE_IDLE:
+    // Between exchanges is the one safe time to move to a better node
+    if(_nodeCheck.shouldRun() && PoolDiscovery::instance().shouldLeave(_node)) {
+      _failover("node degraded");
+    }
     break;
 
-  case POOL_STATE_SUBMITTED:
-    _handleSubmitJobResponse();
-    _setState(POOL_STATE_IDLE);     // our work is done
-    break;
+  case POOL_STATE_SHARE_WAIT:
   default:
     break;
   }
 }
 
+// Take the best pool node from the shared discovery list, never blocks.
+// False until the first lookup has come back
 bool Pool::update() {
-  String input = http_get_string(urlPool);
-  if (input == "")
+  HeapStats::Allow allow;
+  _releaseNode();
+  POOL_ENDPOINT ep;
+  _node = PoolDiscovery::instance().pick(ep);
+  if (_node < 0)
     return false;
-  DynamicJsonDocument doc(256);
-  deserializeJson(doc, input); 
 
-  const char* name = doc["name"];
-  const char* ip = doc["ip"];
-  int port = doc["port"];
-
-  DEBUGPRINT_LN("[POOL]: " + String(name) + " (" + String(ip) + ":" + String(port) + ")");
-  _name = String(name);
-  _host = String(ip);
-  _port = port;
+  _name = String(ep.name);
+  _host = String(ep.host);
+  _port = ep.port;
 
   return (_host.length() > 8 && _port > 1024);
 }
 
+// Starts the connection, the version reply in loop() finishes it. Never blocks
 bool Pool::connect() {
-  if (_client.connected()) return true;
+  if (_client.connected() || _client.connecting()) return true;
+
+  // Back off between failed attempts
+  if (!shouldTryConnect(_lastConnectTry, _tryCount)) return false;
+
+  // Connecting is allowed to allocate, a connection that stays up isn't
+  HeapStats::Allow allow;
 
   // Not connected so clear state
   _setState(POOL_STATE_NONE);
+  _jobRequested = false;
 
   if (_host.isEmpty() || _port <= 0) {
     if(!update()) return false;
@@ -233,27 +229,26 @@ bool Pool::connect() {
 
   Serial.println("[POOL] Connecting to ... " + _host + ":" + String(_port));
   _lastConnectTry = millis();
+  _connectStartMs = _lastConnectTry;
   ++_tryCount;
   if (!_client.connect(_host.c_str(), _port, CLIENT_TIMEOUT_CONNECTION)) {
-    _last_err = F("TCP connect failed");
-    _host = "";
-    _port = 0;
-    _emit_text(POOLEVT_ERROR, _last_err.c_str());
+    _connectFailed();
     return false;
   }
 
-  _lastConnectTry = 0;        // Reset, as we at least got a TCP connection
-  _tryCount = 0;
+  _rx.clear();                // nothing from an old socket carries over
+  _jobAccLen = 0;
 
   // DON'T send connected event here as it will be too early. Wait for
   // the version reply
   // Immediately after connection the server should return with a pool version string
-  _setState(POOL_STATE_VERSION_WAIT); // or MOTD directly if you wish
+  _begin(POOL_STATE_VERSION_WAIT); // or MOTD directly if you wish
   return true;
 }
 
 bool Pool::disconnect() {
   _client.stop();
+  _releaseNode();
   return true;
 }
 
@@ -264,8 +259,8 @@ bool Pool::requestMOTD() {
   }
   if(!connect()) return false;
 
-  _client.println("MOTD");
-  _setState(POOL_STATE_MOTD_WAIT);
+  _send("MOTD\n", 5);
+  _begin(POOL_STATE_MOTD_WAIT);
   return true;
 }
 
@@ -281,36 +276,139 @@ bool Pool::requestJob() {
     return false;
   }
 
-  _poolJob.difficulty = 0;
-
-  // Example from wireshark JOB,[username],AVR,[mining_key]
-  // From ESPCode
-  // JOB,[username],start_diff,miner_key,[Temp: |CPU Temp: ]Value*C
-  // JOB,<username>,<platform>,<rig_id>
-  String line = String("JOB")
-    + SEP_TOKEN + _username
-    + SEP_TOKEN + _startingDifficulty
-    + SEP_TOKEN + MINING_KEY;
+  _poolJob.id = 0;
+  _jobAccLen = 0;
   
   DEBUGPRINT("[POOL] ");
   DEBUGPRINT(_minerName);
   DEBUGPRINT(" Req job: ");
-  DEBUGPRINT_LN(line);
+  DEBUGPRINT(_jobLine);
 
-  bool ret = _sendLine(line);
+  bool ret = _send(_jobLine, _jobLineLen);
 
   if(ret == true) {
-    _setState(POOL_STATE_JOB_WAIT);
+    _jobRequestMs = millis();
+    _begin(POOL_STATE_JOB_WAIT);
   }
   return ret;
 }
 
 Job* Pool::getJob() {
-  return _poolJob.difficulty == 0 ? nullptr : &_poolJob;
+  return _poolJob.id == 0 ? nullptr : &_poolJob;
+}
+
+bool Pool::submitJob(uint32_t foundNonce, uint32_t elapsedTimeUS, const char *workerId) {
+  char submit[POOL_SUBMIT_MAX];
+  size_t len = _formatSubmit(submit, sizeof(submit), foundNonce, elapsedTimeUS, workerId);
+  if(len == 0) {
+    SERIALPRINT_LN("[POOL] Submit line too long, share dropped");
+    return false;
+  }
+
+  DEBUGPRINT("[POOL] Submit: ");
+  DEBUGPRINT(submit);
+
+  bool ret = _send(submit, len);
+  if(ret) {
+    _begin(POOL_STATE_SUBMITTED);
+    return false;
+  }
+  else {
+    // TODO handle this error better
+    return false;
+  }
+}
+
+bool Pool::submitJobAndRequest(uint32_t foundNonce, uint32_t elapsedTimeUS, const char *workerId) {
+  // Both lines in one segment, the server answers them in order
+  char lines[POOL_SUBMIT_MAX + POOL_LINE_MAX];
+  size_t len = _formatSubmit(lines, POOL_SUBMIT_MAX, foundNonce, elapsedTimeUS, workerId);
+  if(len == 0 || len + _jobLineLen >= sizeof(lines)) {
+    // Won't go as one (a long one off worker id), the job gets asked for
+    // once the verdict is in
+    submitJob(foundNonce, elapsedTimeUS, workerId);
+    return false;
+  }
+  memcpy(lines + len, _jobLine, _jobLineLen + 1);
+  len += _jobLineLen;
+
+  DEBUGPRINT("[POOL] Submit + req job: ");
+  DEBUGPRINT(lines);
+
+  _poolJob.id = 0;
+  _jobAccLen = 0;
+  if(!_send(lines, len)) {
+    return false;
+  }
+  _jobRequested = true;
+  _jobRequestMs = millis();
+  _begin(POOL_STATE_SUBMITTED);
+  return true;
+}
+
+// -----------------------------------------------
+//               ------ PRIVATE -------
+// -----------------------------------------------
+
+void Pool::_failover(const char *reason) {
+  HeapStats::Allow allow;
+  SERIALPRINT("[POOL] ");
+  SERIALPRINT(_minerName);
+  SERIALPRINT(" leaving ");
+  SERIALPRINT(_host);
+  SERIALPRINT(": ");
+  SERIALPRINT_LN(reason);
+
+  _last_err = reason;
+  _emit_text(POOLEVT_ERROR, _last_err.c_str());
+  _poolConnectTime = 0;
+  disconnect();
+  _setState(POOL_STATE_CONNECT);
+}
+
+void Pool::_connectFailed() {
+  HeapStats::Allow allow;
+  _last_err = F("TCP connect failed");
+  PoolDiscovery::instance().reportFailure(_node);
+  _releaseNode();
+  _setState(POOL_STATE_NONE);
+  _emit_text(POOLEVT_ERROR, _last_err.c_str());
+}
+
+void Pool::_releaseNode() {
+  PoolDiscovery::instance().unuse(_node);
+  _node = -1;
+  _host = "";
+  _port = 0;
+}
+
+// Example from wireshark JOB,[username],AVR,[mining_key]
+// From ESPCode
+// JOB,[username],start_diff,miner_key,[Temp: |CPU Temp: ]Value*C
+// JOB,<username>,<platform>,<rig_id>
+void Pool::_buildJobLine() {
+  int n = snprintf(_jobLine, sizeof(_jobLine), "JOB%c%s%c%s%c%s%c",
+    SEP_TOKEN, _username.c_str(),
+    SEP_TOKEN, _startingDifficulty,
+    SEP_TOKEN, _miningKey.c_str(),
+    END_TOKEN);
+  _jobLineLen = (n < 0) ? 0 : min((size_t)n, sizeof(_jobLine) - 1);
+}
+
+// Everything in a share after the nonce and hashrate only changes with the
+// worker's identity
+void Pool::_buildSubmitTail() {
+  snprintf(_submitTail, sizeof(_submitTail), "%c%s%c%s%cDUCOID%s%c",
+    SEP_TOKEN, _appName,
+    SEP_TOKEN, _minerName.c_str(),
+    SEP_TOKEN, _workerId.c_str(),
+    //SEP_TOKEN + String(WALLET_GRP_ID) // Might need the wallet ID for grouping String(random(0, 2811)); // Needed for miner grouping in the wallet in the official
+    END_TOKEN);
 }
 
-bool Pool::submitJob(uint32_t foundNonce, uint32_t elapsedTimeUS, String workerId) {
-  String wrkId = workerId.isEmpty() ? _workerId : workerId;
+// The share line with its '\n', 0 if it doesn't fit in out. Cut short
+// it would run into whatever is sent next
+size_t Pool::_formatSubmit(char *out, size_t outSize, uint32_t foundNonce, uint32_t elapsedTimeUS, const char *workerId) {
   float hashrate = foundNonce / (elapsedTimeUS * 0.000001f);
   #if defined(SERIAL_PRINT)
     if(hashrate < 80) {
@@ -322,37 +420,135 @@ bool Pool::submitJob(uint32_t foundNonce, uint32_t elapsedTimeUS, String workerI
       SERIALPRINT_LN(hashrate);
     }
   #endif
-  String submit = String(foundNonce)
-                + SEP_TOKEN + String((hashrate<80) ? 80 + (foundNonce/10.0f) : hashrate )
-                + SEP_TOKEN + _appName
-                + SEP_TOKEN + _minerName
-                + SEP_TOKEN + String("DUCOID") + wrkId
-                //+ SEP_TOKEN + String(WALLET_GRP_ID) // Might need the wallet ID for grouping String(random(0, 2811)); // Needed for miner grouping in the wallet in the official
-                ;
+  if(hashrate < 80) hashrate = 80 + (foundNonce / 10.0f);
 
-  DEBUGPRINT("[POOL] Submit: ");
-  DEBUGPRINT_LN(submit);
-
-  bool ret = _sendLine(submit);       //+ END_TOKEN added by _sendline
-  if(ret) {
-    _setState(POOL_STATE_SUBMITTED);
-    return false;
+  int n;
+  if(workerId == nullptr || *workerId == '\0') {
+    n = snprintf(out, outSize, "%u%c%.2f%s", (unsigned)foundNonce, SEP_TOKEN, hashrate, _submitTail);
   }
   else {
-    // TODO handle this error better
-    return false;
+    // One off worker id, can't use the template's
+    n = snprintf(out, outSize, "%u%c%.2f%c%s%c%s%cDUCOID%s%c", (unsigned)foundNonce, SEP_TOKEN, hashrate,
+      SEP_TOKEN, _appName, SEP_TOKEN, _minerName.c_str(), SEP_TOKEN, workerId, END_TOKEN);
   }
+  return (n < 0 || (size_t)n >= outSize) ? 0 : (size_t)n;
 }
 
-// -----------------------------------------------
-//               ------ PRIVATE -------
-// -----------------------------------------------
-
 void Pool::_setState(DUINO_POOL_STATE state) {
   _state = state;
   _stateStartMS = (state == POOL_STATE_NONE) ? 0 : millis();
 }
 
+void Pool::_begin(DUINO_POOL_STATE state) {
+  _setState(state);
+  _co.reset();
+}
+
+// Connected, the server speaks first with its version
+CoStatus Pool::_greet() {
+  CO_BEGIN(_co);
+
+  _line[0] = '\0';
+  CO_AWAIT(_co, _lineReady() || (!_client.connected() && !_client.connecting()));
+  if(_line[0] == '\0' && !_client.connected() && !_client.connecting()) {
+    _connectFailed();
+    CO_EXIT(_co);
+  }
+
+  {
+    HeapStats::Allow allow;
+    _poolVersion = _line;
+  }
+  _setState(POOL_STATE_IDLE);
+  _poolConnectTime = millis();
+  _lastConnectTry = 0;        // Reset, as we got through to the pool
+  _tryCount = 0;
+  PoolDiscovery::instance().reportConnect(_node, _poolConnectTime - _connectStartMs);
+
+  DEBUGPRINT("[POOL] connected ... ");
+  DEBUGPRINT_LN(_minerName);
+
+  // Only send the connected event once we have a server reply with the version
+  {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s [%s:%d] Ver: %s",
+      _name.c_str(),
+      _host.c_str(),
+      _port,
+      _poolVersion.c_str());
+    _emit_text(POOLEVT_CONNECTED, buf);
+  }
+
+  CO_END(_co);
+}
+
+// The MOTD isn't line based, whatever comes is it
+CoStatus Pool::_readMotd() {
+  CO_BEGIN(_co);
+
+  CO_AWAIT_FOR(_co, _bytesReady(), CLIENT_TIMEOUT_RW);
+  if(_co.timedOut) {
+    PoolDiscovery::instance().reportFailure(_node);
+    _failover("MOTD timeout");
+    CO_EXIT(_co);
+  }
+  {
+    char motd[POOL_RX_BUFFER];
+    _rx.drain(motd, sizeof(motd));
+    HeapStats::Allow allow;
+    _MOTD = motd;
+  }
+  _setState(POOL_STATE_IDLE);
+  _emit_text(POOLEVT_MOTD, _MOTD.c_str());
+
+  CO_END(_co);
+}
+
+// A share's verdict, then the job that went out with it if pipelined, or
+// just a job. Answers come back in the order they were asked for
+CoStatus Pool::_exchange() {
+  CO_BEGIN(_co);
+
+  if(_state == POOL_STATE_SUBMITTED) {
+    CO_AWAIT_FOR(_co, _lineReady(), CLIENT_TIMEOUT_RW);
+    if(_co.timedOut) {
+      // The share's lost either way, don't sit on a node that went quiet
+      PoolDiscovery::instance().reportFailure(_node);
+      _failover("share verdict timeout");
+      CO_EXIT(_co);
+    }
+    _handleSubmitJobResponse(_line);
+    if(!_jobRequested) {
+      _setState(POOL_STATE_IDLE);     // our work is done
+      CO_EXIT(_co);
+    }
+    _jobRequested = false;
+    _setState(POOL_STATE_JOB_WAIT);   // the job is already on its way
+    _emit_nodata(POOLEVT_JOB_REQUESTED);
+  }
+
+  // Timed from the request, a pipelined one went out with the share. Once
+  // part of it is here the rest gets the usual read timeout
+  CO_AWAIT(_co, _recvJobTriplet()
+    || millis() - _jobRequestMs > (_jobAccLen > 0 ? CLIENT_TIMEOUT_RW : POOL_JOB_TIMEOUT_MS));
+  if(_poolJob.id == 0) {
+    // Node too slow to hand out work, try another rather than wait to get stuck
+    PoolDiscovery::instance().reportFailure(_node);
+    _failover(_jobAccLen > 0 ? "JOB recv timeout" : "JOB timeout");
+    CO_EXIT(_co);
+  }
+
+  _setState(POOL_STATE_SHARE_WAIT);
+  PoolDiscovery::instance().reportJobRtt(_node, millis() - _jobRequestMs);
+  {
+    PoolEventData ed;
+    ed.jobDataPtr = &_poolJob;
+    _emit(POOLEVT_JOB_RECEIVED, ed);
+  }
+
+  CO_END(_co);
+}
+
 bool Pool::_isStateStuck() {
   if (_state == POOL_STATE_IDLE
     || _state == POOL_STATE_NONE)
@@ -363,88 +559,109 @@ bool Pool::_isStateStuck() {
   return (millis() - _stateStartMS > STATE_STUCK_TIMEOUT) ? true : false;
 }
 
-bool Pool::_sendLine(const String& s) {
+bool Pool::_send(const char *data, size_t len) {
   if (!_client.connected()) return false;
-  size_t n = _client.print(s + END_TOKEN);
-  return n == (s.length() + 1);
-}
-
-bool Pool::_readLine(String& out, uint32_t timeout_ms) {
-  out = "";
-  uint32_t start = millis();
-  while (millis() - start < timeout_ms) {
-    while (_client.available()) {
-      int c = _client.read();
-      if (c < 0) break;
-      if (c == '\r') continue;
-      if (c == END_TOKEN) return true;
-      out += char(c);
-    }
-    delay(0);
-  }
-  // Tolerate partial line
-  return !out.isEmpty();
-}
-
-bool Pool::_splitTripletCSV(const String& s, String& a, String& b, String& c) {
-  int p1 = s.indexOf(SEP_TOKEN);
-  if (p1 < 0) return false;
-  int p2 = s.indexOf(SEP_TOKEN, p1 + 1);
-  if (p2 < 0) return false;
-  a = s.substring(0, p1);
-  b = s.substring(p1 + 1, p2);
-  c = s.substring(p2 + 1);
-  a.trim(); b.trim(); c.trim();
-  return (a.length() == 40 && b.length() == 40 && c.length() > 0);
-}
-
-bool Pool::_recvJobTriplet(String& seed40, String& target40, uint16_t& diff) {
-  String acc;
-  const uint32_t start = millis();
-  while (millis() - start < 5000UL) {
-    String line;
-    _readLine(line, CLIENT_TIMEOUT_RW);
-    if (line.length() == 0) { delay(0); continue; }
-    if (!acc.isEmpty()) acc += SEP_TOKEN;
-    acc += line;
-
-    String a, b, c;
-    if (_splitTripletCSV(acc, a, b, c)) {
-      seed40 = a; target40 = b; diff = (uint16_t)c.toInt();
-      return true;
-    }
+  size_t n = _client.write((const uint8_t *)data, len);
+  return n == len;
+}
+
+bool Pool::_lineReady() {
+  _rx.feed(_client);
+  return _nextLine();
+}
+
+bool Pool::_bytesReady() {
+  return _rx.feed(_client) > 0 || _rx.size() > 0;
+}
+
+bool Pool::_nextLine() {
+  int len = _rx.nextLine(_line, sizeof(_line));
+  if (len < 0) return false;
+  // The server pads some replies
+  while (len > 0 && _line[len - 1] == ' ') _line[--len] = '\0';
+  return true;
+}
+
+static char *_trimField(char *s) {
+  while (*s == ' ') s++;
+  char *end = s + strlen(s);
+  while (end > s && end[-1] == ' ') *--end = '\0';
+  return s;
+}
+
+// Lines are gathered until they make up seed,target,diff. Returns true and
+// fills _poolJob once they do, false while waiting for more
+bool Pool::_recvJobTriplet() {
+  _rx.feed(_client);
+  while (_nextLine()) {
+    const size_t len = strlen(_line);
+    if (len == 0) continue;
+
+    if (_jobAccLen + len + 2 > sizeof(_jobAcc)) _jobAccLen = 0;   // junk, start over
+    if (_jobAccLen > 0) _jobAcc[_jobAccLen++] = SEP_TOKEN;
+    memcpy(_jobAcc + _jobAccLen, _line, len + 1);
+    _jobAccLen += len;
+
+    // Split a copy, a partial triplet has to stay intact for the next line
+    char fields[POOL_LINE_MAX];
+    memcpy(fields, _jobAcc, _jobAccLen + 1);
+    char *p1 = strchr(fields, SEP_TOKEN);
+    if (p1 == nullptr) continue;
+    char *p2 = strchr(p1 + 1, SEP_TOKEN);
+    if (p2 == nullptr) continue;
+    *p1 = '\0';
+    *p2 = '\0';
+    char *seed = _trimField(fields);
+    char *target = _trimField(p1 + 1);
+    char *diff = _trimField(p2 + 1);
+    if (strlen(seed) != 40 || strlen(target) != 40 || *diff == '\0') continue;
+
+    // Decoded once here, everyone after works from the raw bytes
+    uint32_t id = ++_jobCounter;
+    if (id == 0) id = ++_jobCounter;
+    decodeJob(_poolJob, seed, target, (uint16_t)atoi(diff), id);
+    _jobAccLen = 0;
+    return true;
   }
   return false;
 }
 
 // Handle the response after a share has been submitted
-bool Pool::_handleSubmitJobResponse() {
-  String resp;
-  if (!_readLine(resp, CLIENT_TIMEOUT_RW)) return false;
-  resp.trim();
-
+bool Pool::_handleSubmitJobResponse(const char *resp) {
   DEBUGPRINT("[POOL] Resp from share submit: ");
   DEBUGPRINT_LN(resp);  
 
-  if (resp.equalsIgnoreCase(GOOD)) {
-    _emit_text(POOLEVT_RESULT_GOOD, resp.c_str());
+  const bool good = strcasecmp(resp, GOOD) == 0;
+  const bool block = strcasecmp(resp, BLOCK) == 0;
+  PoolDiscovery::instance().reportShare(_node, good || block);
+
+  if (good) {
+    _emit_text(POOLEVT_RESULT_GOOD, resp);
     return true;
-  } else if (resp.equalsIgnoreCase(BLOCK)) {
-    _emit_text(POOLEVT_RESULT_BLOCK, resp.c_str());
+  } else if (block) {
+    _emit_text(POOLEVT_RESULT_BLOCK, resp);
     return true;
   }
   else{
     // Treat anything else as BAD
-    PoolEventData d; d.text = resp.c_str();
+    PoolEventData d; d.text = resp;
     _emit(POOLEVT_RESULT_BAD, d);
     return false;
   }
 }
 
+// Queued on the http service, the answer comes back in _onMiningKeyStatus
 void Pool::_checkMiningKey(String new_mining_key, String ducouser)
 {
     String url = String(urlMiningKeyStatus) + "?u=" + String(ducouser) + "&k=" + new_mining_key;
-    String response = http_get_string(url);
+    if (!HttpService::instance().get(url, &Pool::_onMiningKeyStatus, this)) {
+      Serial.println("[POOL] CheckMiningKey request queue full");
+    }
+}
+
+void Pool::_onMiningKeyStatus(int status, const String& response, void *user)
+{
+    Pool* self = static_cast<Pool*>(user);
     if (response == "")
       return;
 
@@ -459,10 +676,10 @@ void Pool::_checkMiningKey(String new_mining_key, String ducouser)
 
     if (success && !has_key) {
         Serial.println("[POOL] Wallet does not have a mining key. Proceed..");
-        setMiningKey("None");
+        self->setMiningKey("None");
     }
     else if (!success) {
-        if (_miningKey == "None") {
+        if (self->_miningKey == "None") {
             Serial.println("[POOL] Update mining_key to proceed. Halt..");
             //ws_send_all("Update mining_key to proceed. Halt..");
             for(;;);
@@ -475,6 +692,6 @@ void Pool::_checkMiningKey(String new_mining_key, String ducouser)
     }
     else {
         Serial.println("[POOL] Updated mining_key..");
-        setMiningKey(_miningKey);
+        self->setMiningKey(self->_miningKey);
     }
 }
\ No newline at end of file
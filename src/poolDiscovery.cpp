@@ -0,0 +1,316 @@
+#include "config.h"
+#include "poolDiscovery.h"
+#include "httpService.h"
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ArduinoJson.h>
+#include <Preferences.h>
+#include <HTTPClient.h>
+
+// HTTPS needs a roomy stack
+#define DISCOVERY_TASK_STACK  8192
+#define DISCOVERY_TASK_PRIO   1
+#define DISCOVERY_NVS_NS      "pooldisc"
+// Cost of a node we haven't measured yet, low enough that it gets tried
+#define UNMEASURED_RTT_MS     200
+#define ERROR_RATE_DOWN       0.5f
+
+static const char * urlGetPool = "https://server.duinocoin.com/getPool";
+
+PoolDiscovery& PoolDiscovery::instance() {
+  static PoolDiscovery discovery;
+  return discovery;
+}
+
+void PoolDiscovery::begin() {
+  if (_task != nullptr) return;
+
+  _lock = xSemaphoreCreateMutex();
+  _load();
+
+  if (xTaskCreate(&PoolDiscovery::_taskMain, "pool_disc", DISCOVERY_TASK_STACK, this, DISCOVERY_TASK_PRIO, &_task) != pdPASS) {
+    _task = nullptr;
+    SERIALPRINT_LN("[POOL_DISC] Can't start discovery task");
+  }
+}
+
+int8_t PoolDiscovery::pick(POOL_ENDPOINT &out) {
+  int8_t best = -1;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  const uint32_t now = millis();
+  uint32_t bestCost = UINT32_MAX;
+  bool bestHealthy = false;
+  for (uint8_t i = 0; i < _numNodes; i++) {
+    POOL_NODE_STATS& n = _nodes[i];
+    // Hold off is over, give it another go on probation
+    if (n.downUntilMs != 0 && (int32_t)(now - n.downUntilMs) >= 0) {
+      n.downUntilMs = 0;
+      n.errorRate = ERROR_RATE_DOWN / 2;
+      n.jobRttMs = 0;
+    }
+    const bool healthy = _isHealthy(n, now);
+    const uint32_t cost = _cost(n);
+    // Healthy nodes always win, a down one only if there's nothing else
+    if ((healthy && !bestHealthy) || (healthy == bestHealthy && cost < bestCost)) {
+      best = i;
+      bestCost = cost;
+      bestHealthy = healthy;
+    }
+  }
+  if (best >= 0) {
+    out = _nodes[best].ep;
+    _nodes[best].activeConns++;
+  }
+  xSemaphoreGive(_lock);
+
+  if (best < 0 && _task != nullptr) xTaskNotifyGive(_task);
+  return best;
+}
+
+void PoolDiscovery::unuse(int8_t node) {
+  if (node < 0 || node >= _numNodes) return;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (_nodes[node].activeConns > 0) _nodes[node].activeConns--;
+  xSemaphoreGive(_lock);
+}
+
+void PoolDiscovery::reportConnect(int8_t node, uint32_t rttMs) {
+  if (node < 0 || node >= _numNodes) return;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  POOL_NODE_STATS& n = _nodes[node];
+  n.connectRttMs = n.connectRttMs ? (3 * n.connectRttMs + rttMs) / 4 : rttMs;
+  n.connects++;
+  _recordError(n, false);
+  xSemaphoreGive(_lock);
+}
+
+void PoolDiscovery::reportJobRtt(int8_t node, uint32_t rttMs) {
+  if (node < 0 || node >= _numNodes) return;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  POOL_NODE_STATS& n = _nodes[node];
+  n.jobRttMs = n.jobRttMs ? (3 * n.jobRttMs + rttMs) / 4 : rttMs;
+  _recordError(n, false);
+  if (n.jobRttMs > POOL_RTT_DEGRADED_MS) {
+    n.downUntilMs = (millis() + POOL_NODE_HOLDOFF_MS) | 1;
+  }
+  xSemaphoreGive(_lock);
+}
+
+void PoolDiscovery::reportShare(int8_t node, bool good) {
+  if (node < 0 || node >= _numNodes) return;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (good) _nodes[node].sharesGood++;
+  else _nodes[node].sharesBad++;
+  xSemaphoreGive(_lock);
+}
+
+void PoolDiscovery::reportFailure(int8_t node) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (node >= 0 && node < _numNodes) {
+    _nodes[node].failures++;
+    _recordError(_nodes[node], true);
+  }
+  // Worth asking the server if something better is about
+  _refreshWanted = true;
+  xSemaphoreGive(_lock);
+  if (_task != nullptr) xTaskNotifyGive(_task);
+}
+
+bool PoolDiscovery::shouldLeave(int8_t node) {
+  if (node < 0 || node >= _numNodes) return false;
+
+  bool leave = false;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  const uint32_t now = millis();
+  if (!_isHealthy(_nodes[node], now)) {
+    for (uint8_t i = 0; i < _numNodes && !leave; i++) {
+      leave = (i != node && _isHealthy(_nodes[i], now));
+    }
+  }
+  xSemaphoreGive(_lock);
+  return leave;
+}
+
+void PoolDiscovery::requestRefresh() {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _refreshWanted = true;
+  xSemaphoreGive(_lock);
+  if (_task != nullptr) xTaskNotifyGive(_task);
+}
+
+bool PoolDiscovery::getNode(uint8_t node, POOL_NODE_STATS &out) {
+  if (node >= _numNodes) return false;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  out = _nodes[node];
+  xSemaphoreGive(_lock);
+  return true;
+}
+
+// -----------------------------------------------
+//               ------ PRIVATE -------
+// -----------------------------------------------
+
+void PoolDiscovery::_taskMain(void *arg) {
+  PoolDiscovery* self = static_cast<PoolDiscovery*>(arg);
+
+  for (;;) {
+    // Woken early when someone is waiting on a node
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    if (!WiFi.isConnected() || !self->_due()) continue;
+
+    // getPool balances between nodes, a few asks fill in the candidates.
+    // The connection is kept alive so only the first pays the handshake
+    uint8_t answers = 0;
+    bool changed = false;
+    for (uint8_t p = 0; p < POOL_MAX_NODES; p++) {
+      POOL_ENDPOINT ep = {};
+      if (!self->_fetch(ep)) break;
+      answers++;
+      xSemaphoreTake(self->_lock, portMAX_DELAY);
+      changed |= self->_merge(ep);
+      xSemaphoreGive(self->_lock);
+    }
+
+    xSemaphoreTake(self->_lock, portMAX_DELAY);
+    self->_lastAttemptMs = millis();
+    if (answers > 0) {
+      self->_fromNvs = false;
+      self->_refreshWanted = false;
+      self->_fetchedMs = self->_lastAttemptMs;
+      self->_fetchCount++;
+    }
+    else {
+      // Keep whatever we had, it may still work
+      self->_failCount++;
+    }
+    xSemaphoreGive(self->_lock);
+
+    // Only write flash when the list moves
+    if (changed) self->_save();
+  }
+}
+
+bool PoolDiscovery::_due() {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  const uint32_t now = millis();
+  bool due = (_numNodes == 0) || _fromNvs || _refreshWanted || (now - _fetchedMs > POOL_DISCOVERY_TTL_MS);
+  // Negative cache, don't hammer the server after a failed lookup
+  if (_lastAttemptMs != 0 && now - _lastAttemptMs < POOL_DISCOVERY_RETRY_MS) due = false;
+  xSemaphoreGive(_lock);
+  return due;
+}
+
+bool PoolDiscovery::_fetch(POOL_ENDPOINT &ep) {
+  // Already in our own task, the blocking call shares the kept-alive connection
+  String input;
+  if (HttpService::instance().fetch(urlGetPool, input) != HTTP_CODE_OK || input == "")
+    return false;
+  DynamicJsonDocument doc(256);
+  if (deserializeJson(doc, input)) return false;
+
+  const char* name = doc["name"];
+  const char* ip = doc["ip"];
+  int port = doc["port"];
+  if (ip == nullptr || strlen(ip) < 8 || port <= 1024) return false;
+
+  strncpy(ep.name, name ? name : "", sizeof(ep.name) - 1);
+  strncpy(ep.host, ip, sizeof(ep.host) - 1);
+  ep.port = port;
+
+  DEBUGPRINT_LN("[POOL_DISC]: " + String(ep.name) + " (" + String(ep.host) + ":" + String(port) + ")");
+  return true;
+}
+
+/// Add a node to the candidates, true if the list changed. When full the
+/// worst unused node makes room. Indexes of nodes in use never move
+bool PoolDiscovery::_merge(const POOL_ENDPOINT &ep) {
+  for (uint8_t i = 0; i < _numNodes; i++) {
+    if (_nodes[i].ep.port == ep.port && strcmp(_nodes[i].ep.host, ep.host) == 0) return false;
+  }
+
+  int8_t slot = -1;
+  if (_numNodes < POOL_MAX_NODES) {
+    slot = _numNodes++;
+  }
+  else {
+    const uint32_t now = millis();
+    uint32_t worst = 0;
+    for (uint8_t i = 0; i < _numNodes; i++) {
+      if (_nodes[i].activeConns > 0) continue;
+      const uint32_t cost = _isHealthy(_nodes[i], now) ? _cost(_nodes[i]) : UINT32_MAX;
+      if (slot < 0 || cost >= worst) {
+        slot = i;
+        worst = cost;
+      }
+    }
+    if (slot < 0) return false;     // all busy, try again next refresh
+  }
+
+  _nodes[slot] = POOL_NODE_STATS{};
+  _nodes[slot].ep = ep;
+  SERIALPRINT("[POOL_DISC] Pool node ");
+  SERIALPRINT(ep.host);
+  SERIALPRINT(":");
+  SERIALPRINT_LN(ep.port);
+  return true;
+}
+
+bool PoolDiscovery::_isHealthy(const POOL_NODE_STATS &n, uint32_t now) const {
+  return n.downUntilMs == 0 || (int32_t)(now - n.downUntilMs) >= 0;
+}
+
+/// Lower is better. Latency, inflated by errors and by how many of our
+/// connections are already on the node so workers spread out
+uint32_t PoolDiscovery::_cost(const POOL_NODE_STATS &n) const {
+  const uint32_t rtt = (n.jobRttMs ? n.jobRttMs : UNMEASURED_RTT_MS)
+                     + (n.connectRttMs ? n.connectRttMs : UNMEASURED_RTT_MS) / 4;
+  return (uint32_t)(rtt * (1.0f + 4.0f * n.errorRate)) * (n.activeConns + 1);
+}
+
+void PoolDiscovery::_recordError(POOL_NODE_STATS &n, bool failed) {
+  n.errorRate = n.errorRate * 0.75f + (failed ? 0.25f : 0.0f);
+  if (failed && n.errorRate > ERROR_RATE_DOWN) {
+    n.downUntilMs = (millis() + POOL_NODE_HOLDOFF_MS) | 1;
+  }
+}
+
+void PoolDiscovery::_load() {
+  POOL_ENDPOINT eps[POOL_MAX_NODES];
+  size_t count = 0;
+
+  Preferences prefs;
+  if (!prefs.begin(DISCOVERY_NVS_NS, true)) return;
+  const size_t len = prefs.getBytesLength("eps");
+  if (len > 0 && len <= sizeof(eps) && (len % sizeof(POOL_ENDPOINT)) == 0) {
+    prefs.getBytes("eps", eps, len);
+    count = len / sizeof(POOL_ENDPOINT);
+  }
+  prefs.end();
+
+  for (size_t i = 0; i < count; i++) {
+    eps[i].name[sizeof(eps[i].name) - 1] = '\0';
+    eps[i].host[sizeof(eps[i].host) - 1] = '\0';
+    if (eps[i].port > 0 && eps[i].host[0] != '\0') {
+      _merge(eps[i]);
+    }
+  }
+  _fromNvs = (_numNodes > 0);
+}
+
+void PoolDiscovery::_save() {
+  POOL_ENDPOINT eps[POOL_MAX_NODES];
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  const uint8_t count = _numNodes;
+  for (uint8_t i = 0; i < count; i++) eps[i] = _nodes[i].ep;
+  xSemaphoreGive(_lock);
+
+  Preferences prefs;
+  if (!prefs.begin(DISCOVERY_NVS_NS, false)) {
+    SERIALPRINT_LN("[POOL_DISC] Can't open NVS to save pool nodes");
+    return;
+  }
+  prefs.remove("ep");     // single node from older firmware
+  prefs.putBytes("eps", eps, count * sizeof(POOL_ENDPOINT));
+  prefs.end();
+}
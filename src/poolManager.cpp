@@ -0,0 +1,156 @@
+#include "config.h"
+#include "poolManager.h"
+#include "bootArena.h"
+
+PoolManager::PoolManager(const String &username, const String &miningKey)
+  : _username(username), _miningKey(miningKey) {
+}
+
+void PoolManager::begin(uint8_t numWorkers, uint8_t maxConnections) {
+  if (_workers != nullptr) return;     // sized once, workers hold on to their slots
+
+  _numWorkers = min(numWorkers, (uint8_t)MAX_I2C_WORKERS);
+  _numConns = min(min(_numWorkers, maxConnections), (uint8_t)POOL_MAX_CONNECTIONS);
+  if (_numConns == 0 && _numWorkers > 0) _numConns = 1;
+
+  _workers = BootArena::instance().makeArray<_Worker>(_numWorkers ? _numWorkers : 1);
+  _conns = BootArena::instance().makeArray<_Conn>(_numConns ? _numConns : 1);
+
+  for (uint8_t c = 0; c < _numConns; c++) {
+    _conns[c].mgr = this;
+    _conns[c].pool = BootArena::instance().make<Pool>(_username, _miningKey, DEVICE_AVR);
+    _conns[c].pool->addEventListener(&PoolManager::_eventSink, &_conns[c]);
+  }
+
+  // Spread the workers evenly, each one always uses the same connection
+  for (uint8_t w = 0; w < _numWorkers; w++) {
+    _workers[w].conn = w % _numConns;
+  }
+
+  SERIALPRINT("[POOL_MGR] ");
+  SERIALPRINT(_numWorkers);
+  SERIALPRINT(" worker(s) over ");
+  SERIALPRINT(_numConns);
+  SERIALPRINT_LN(" pool connection(s)");
+}
+
+void PoolManager::loop() {
+  for (uint8_t c = 0; c < _numConns; c++) {
+    Pool* pool = _conns[c].pool;
+    // Only keep sockets up that someone is waiting for
+    if (_isMining && _conns[c].queueLen > 0 && !pool->isConnected()) {
+      pool->connect();
+    }
+    pool->loop();
+  }
+}
+
+void PoolManager::setMining(bool flag) {
+  _isMining = flag;
+  if (!flag) disconnectAll();
+}
+
+void PoolManager::disconnectAll() {
+  for (uint8_t c = 0; c < _numConns; c++) {
+    _conns[c].pool->disconnect();
+    _conns[c].head = _NONE;
+    _conns[c].tail = _NONE;
+    _conns[c].queueLen = 0;
+  }
+  for (uint8_t w = 0; w < _numWorkers; w++) {
+    _workers[w].queued = false;
+    _workers[w].next = _NONE;
+  }
+}
+
+void PoolManager::setWorker(uint8_t worker, const String &minerName, DeviceType type, PoolEventCallback cb, void *user) {
+  if (worker >= _numWorkers) return;
+  snprintf(_workers[worker].minerName, sizeof(_workers[worker].minerName), "%s", minerName.c_str());
+  _workers[worker].type = type;
+  _workers[worker].cb = cb;
+  _workers[worker].user = user;
+
+  // With a connection each nothing changes hands, set it up front
+  if (_numConns == _numWorkers) {
+    Pool* pool = _conns[_workers[worker].conn].pool;
+    pool->setMinerName(_workers[worker].minerName);
+    pool->setDeviceType(type);
+  }
+}
+
+Pool* PoolManager::acquire(uint8_t worker) {
+  if (worker >= _numWorkers || _numConns == 0) return nullptr;
+  _Worker& w = _workers[worker];
+  _Conn& conn = _conns[w.conn];
+
+  if (!w.queued) {
+    w.next = _NONE;
+    if (conn.queueLen == 0) conn.head = worker;
+    else _workers[conn.tail].next = worker;
+    conn.tail = worker;
+    conn.queueLen++;
+    w.queued = true;
+    if (conn.queueLen == 1) _grant(w.conn);
+  }
+
+  return (conn.head == worker) ? conn.pool : nullptr;
+}
+
+void PoolManager::release(uint8_t worker) {
+  if (worker >= _numWorkers) return;
+  _Worker& w = _workers[worker];
+  _Conn& conn = _conns[w.conn];
+  if (!w.queued || conn.queueLen == 0) return;
+
+  const bool wasOwner = (conn.head == worker);
+  _unlink(conn, worker);
+  w.queued = false;
+  if (wasOwner && conn.queueLen > 0) _grant(w.conn);
+}
+
+bool PoolManager::hasWaiters(uint8_t worker) const {
+  if (worker >= _numWorkers) return false;
+  return _conns[_workers[worker].conn].queueLen > 1;
+}
+
+Pool* PoolManager::getPool(uint8_t worker) {
+  if (worker >= _numWorkers || _numConns == 0) return nullptr;
+  return _conns[_workers[worker].conn].pool;
+}
+
+// -----------------------------------------------
+//               ------ PRIVATE -------
+// -----------------------------------------------
+
+void PoolManager::_grant(uint8_t conn) {
+  _Conn& c = _conns[conn];
+  const uint8_t owner = c.head;
+  c.leases++;
+  if (_numConns != _numWorkers) {
+    c.pool->setMinerName(_workers[owner].minerName);
+    c.pool->setDeviceType(_workers[owner].type);
+  }
+}
+
+void PoolManager::_eventSink(PoolEvent ev, const PoolEventData& d, void *user) {
+  _Conn* conn = static_cast<_Conn*>(user);
+  if (conn->queueLen == 0) return;      // nobody holds the connection
+
+  _Worker& w = conn->mgr->_workers[conn->head];
+  if (w.cb) w.cb(ev, d, w.user);
+}
+
+// Take the worker out of the queue, wherever it is in it
+void PoolManager::_unlink(_Conn &conn, uint8_t worker) {
+  uint8_t prev = _NONE;
+  for (uint8_t w = conn.head; w != _NONE; prev = w, w = _workers[w].next) {
+    if (w != worker) continue;
+    const uint8_t next = _workers[w].next;
+    if (prev == _NONE) conn.head = next;
+    else _workers[prev].next = next;
+    if (conn.tail == worker) conn.tail = prev;
+    _workers[w].next = _NONE;
+    conn.queueLen--;
+    return;
+  }
+}
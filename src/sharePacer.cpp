@@ -0,0 +1,55 @@
+#include "sharePacer.h"
+
+#define PACER_BUCKET0_MS    250UL
+#define PACER_LEARN_RATE    0.2f    // weight of a new verdict
+#define PACER_FORGET_RATE   0.02f   // how fast held back buckets drift to trusted
+
+SharePacer::SharePacer() {
+  // Trust every job age until the pool says otherwise, i.e. no hold
+  for (uint8_t b = 0; b < PACER_BUCKETS; b++) _accept[b] = 1.0f;
+}
+
+void SharePacer::onSubmit(uint32_t jobAgeMs) {
+  _lastAgeMs = jobAgeMs;
+  _awaitingVerdict = true;
+}
+
+void SharePacer::onVerdict(bool accepted) {
+  if (!_awaitingVerdict) return;
+  _awaitingVerdict = false;
+
+  const uint8_t b = _bucket(_lastAgeMs);
+  _accept[b] += ((accepted ? 1.0f : 0.0f) - _accept[b]) * PACER_LEARN_RATE;
+
+  // Shares are never sent from the buckets under the hold, so nothing
+  // would ever clear them. Let them drift back instead
+  for (uint8_t i = 0; i < b; i++) {
+    _accept[i] += (1.0f - _accept[i]) * PACER_FORGET_RATE;
+  }
+  _choose();
+}
+
+// -----------------------------------------------
+//               ------ PRIVATE -------
+// -----------------------------------------------
+
+uint8_t SharePacer::_bucket(uint32_t ms) {
+  uint8_t b = 0;
+  while (b < PACER_BUCKETS - 1 && ms >= (PACER_BUCKET0_MS << b)) b++;
+  return b;
+}
+
+/// Accepted shares per minute go roughly as acceptance over the time a
+/// share takes, take each bucket at its upper edge
+void SharePacer::_choose() {
+  uint8_t best = 0;
+  float bestRate = 0;
+  for (uint8_t b = 0; b < PACER_BUCKETS; b++) {
+    const float rate = _accept[b] / (float)(PACER_BUCKET0_MS << b);
+    if (rate > bestRate) {
+      best = b;
+      bestRate = rate;
+    }
+  }
+  _holdMs = (best == 0) ? 0 : min(PACER_BUCKET0_MS << (best - 1), PACER_MAX_HOLD_MS);
+}
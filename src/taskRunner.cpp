@@ -0,0 +1,116 @@
+#include "taskRunner.h"
+
+#include <stdio.h>
+
+#if defined(ESP_PLATFORM)
+  #include "heapStats.h"
+  #include <esp_timer.h>
+#else
+  #include <chrono>
+#endif
+
+TaskRunner* TaskRunner::_all[TASK_RUNNER_MAX] = {};
+uint8_t TaskRunner::_count = 0;
+
+TaskRunner::TaskRunner(const char *name, StepFn step, void *arg, uint32_t periodMs,
+                       uint32_t stackBytes, uint8_t priority, int8_t core)
+  : _name(name), _step(step), _arg(arg), _periodMs(periodMs ? periodMs : 1),
+    _stackBytes(stackBytes), _priority(priority), _core(core) {}
+
+/// Runners are started from setup(), before any of them can be reporting
+bool TaskRunner::start() {
+  if (_count >= TASK_RUNNER_MAX) return false;
+  _reportAtUs = _nowUs();
+
+#if defined(ESP_PLATFORM)
+  if (_handle != nullptr) return true;
+  const BaseType_t ok = (_core < 0)
+    ? xTaskCreate(&TaskRunner::_taskMain, _name, _stackBytes, this, _priority, &_handle)
+    : xTaskCreatePinnedToCore(&TaskRunner::_taskMain, _name, _stackBytes, this, _priority, &_handle, _core);
+  if (ok != pdPASS) {
+    _handle = nullptr;
+    return false;
+  }
+  HeapStats::instance().track(_name, _handle, _heapStrict);
+#else
+  // Stack size, priority and core only mean something to FreeRTOS
+  if (_thread != nullptr) return true;
+  _thread = new std::thread(&TaskRunner::_taskMain, this);
+  _thread->detach();
+#endif
+
+  _all[_count++] = this;
+  return true;
+}
+
+void TaskRunner::notify() {
+#if defined(ESP_PLATFORM)
+  if (_handle != nullptr) xTaskNotifyGive(_handle);
+#else
+  {
+    std::lock_guard<std::mutex> lock(_wakeLock);
+    _notified = true;
+  }
+  _wake.notify_one();
+#endif
+}
+
+uint32_t TaskRunner::getStackHighWater() const {
+#if defined(ESP_PLATFORM)
+  // ESP-IDF counts stack in bytes, not words
+  return _handle ? uxTaskGetStackHighWaterMark(_handle) : 0;
+#else
+  return 0;
+#endif
+}
+
+size_t TaskRunner::formatReport(char *buf, size_t size) {
+  const uint32_t now = _nowUs();
+  const uint32_t busy = _busyUs.load(std::memory_order_relaxed);
+  const uint32_t wall = now - _reportAtUs;
+  const float load = wall ? 100.0f * (float)(busy - _reportBusyUs) / (float)wall : 0;
+  _reportAtUs = now;
+  _reportBusyUs = busy;
+
+  const int n = snprintf(buf, size, "%-8s core %2d  steps %9u  cpu %5.1f%%  stack free %5u",
+    _name, _core, (unsigned)getSteps(), load, (unsigned)getStackHighWater());
+  return (n < 0) ? 0 : (size_t)n;
+}
+
+// -----------------------------------------------
+//               ------ PRIVATE -------
+// -----------------------------------------------
+
+uint32_t TaskRunner::_nowUs() {
+#if defined(ESP_PLATFORM)
+  return (uint32_t)esp_timer_get_time();
+#else
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void TaskRunner::_taskMain(void *arg) {
+  TaskRunner* self = static_cast<TaskRunner*>(arg);
+
+  for (;;) {
+    const uint32_t start = _nowUs();
+    const uint32_t sleepMs = self->_step(self->_arg);
+    self->_busyUs.fetch_add(_nowUs() - start, std::memory_order_relaxed);
+    self->_steps.fetch_add(1, std::memory_order_relaxed);
+    self->_wait(sleepMs < self->_periodMs ? sleepMs : self->_periodMs);
+  }
+}
+
+/// Always gives up the CPU for at least a tick, so lower priority tasks
+/// and the idle task's watchdog get a look in
+void TaskRunner::_wait(uint32_t ms) {
+#if defined(ESP_PLATFORM)
+  TickType_t ticks = pdMS_TO_TICKS(ms);
+  ulTaskNotifyTake(pdTRUE, ticks ? ticks : 1);
+#else
+  std::unique_lock<std::mutex> lock(_wakeLock);
+  _wake.wait_for(lock, std::chrono::milliseconds(ms), [this]() { return _notified; });
+  _notified = false;
+#endif
+}
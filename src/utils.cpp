@@ -31,7 +31,10 @@ const uint8_t base36CharValues[75] PROGMEM{
 
 uint8_t* hexStringToUint8Array(const String &hexString, uint8_t *uint8Array, const uint32_t arrayLength) {
     assert(hexString.length() >= arrayLength * 2);
-    const char *hexChars = hexString.c_str();
+    return hexStringToUint8Array(hexString.c_str(), uint8Array, arrayLength);
+}
+
+uint8_t* hexStringToUint8Array(const char *hexChars, uint8_t *uint8Array, const uint32_t arrayLength) {
     for (uint32_t i = 0; i < arrayLength; ++i) {
         uint8Array[i] = (pgm_read_byte(base36CharValues + hexChars[i * 2] - '0') << 4) + pgm_read_byte(base36CharValues + hexChars[i * 2 + 1] - '0');
     }
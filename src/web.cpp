@@ -1,5 +1,7 @@
 #include "web.h"
 #include "config.h"
+#include "poolDiscovery.h"
+#include "eventBus.h"
 
 #include <LittleFS.h>
 #include <ESPAsyncWebServer.h>
@@ -8,6 +10,7 @@
 AsyncWebServer server(80);
 // If you use WS/SSE, declare them here and expose helpers in web.h as needed.
 static AsyncWebSocket ws("/ws");
+static int8_t wsEvents = -1;   // EventBus cursor, pushed to the websocket
 
 const char* http_username = "admin";
 const char* http_password = "admin";
@@ -24,6 +27,26 @@ static void register_routes() {
     req->send(200, "application/json", json);
   });
 
+  // Pool nodes with their round trips and share counts
+  server.on("/api/pools", HTTP_GET, [](AsyncWebServerRequest *req){
+    PoolDiscovery& disc = PoolDiscovery::instance();
+    String json = "[";
+    for (uint8_t n = 0; n < disc.getNodeCount(); n++) {
+      POOL_NODE_STATS node;
+      if (!disc.getNode(n, node)) continue;
+      char buf[256];
+      snprintf(buf, sizeof(buf),
+        "%s{\"name\":\"%s\",\"host\":\"%s\",\"port\":%u,\"connect_ms\":%u,\"job_ms\":%u,"
+        "\"error_rate\":%.2f,\"active\":%u,\"failures\":%u,\"good\":%u,\"bad\":%u,\"down\":%s}",
+        n ? "," : "", node.ep.name, node.ep.host, node.ep.port, node.connectRttMs, node.jobRttMs,
+        node.errorRate, node.activeConns, node.failures, node.sharesGood, node.sharesBad,
+        node.downUntilMs ? "true" : "false");
+      json += buf;
+    }
+    json += "]";
+    req->send(200, "application/json", json);
+  });
+
   // If using WS/SSE, register handlers here
   server.addHandler(&ws);
 }
@@ -39,11 +62,31 @@ void web_setup() {
   //   return;
   // }
   register_routes();
+  wsEvents = EventBus::instance().subscribe("web");
   server.begin();
   Serial.println("[WEB] Server started");
 }
 
+static void ws_send_event(const BusEvent &ev, void *user) {
+  if (ws.count() == 0) return;    // still drained so the cursor keeps up
+  // Pool text is whatever the server sent, keep it from breaking the JSON
+  char text[EVENT_TEXT_LEN];
+  size_t n = 0;
+  for (; ev.text[n] != '\0' && n < sizeof(text) - 1; n++) {
+    const char c = ev.text[n];
+    text[n] = (c == '"' || c == '\\' || (uint8_t)c < 0x20) ? '\'' : c;
+  }
+  text[n] = '\0';
+
+  char buf[160];
+  snprintf(buf, sizeof(buf),
+    "{\"ms\":%u,\"src\":%u,\"type\":%u,\"addr\":%u,\"a\":%u,\"b\":%u,\"c\":%u,\"text\":\"%s\"}",
+    ev.ms, ev.source, ev.type, ev.address, ev.a, ev.b, ev.c, text);
+  ws.textAll(buf);
+}
+
 void web_loop() {
+  EventBus::instance().drain(wsEvents, ws_send_event);
   // If you use websockets, you might do periodic cleanup, e.g.:
   // ws.cleanupClients();
 }
@@ -1,172 +1,181 @@
+#include "config.h"
 #include "wirewrap.h"
-#include <Wire.h>
+#include "I2CMaster.h"
 
-// Just supporting ESP32 here
-#define SDA 21
-#define SCL 22
+#define END_TOKEN  '\n'
+#define SEP_TOKEN  ','
 
-#define WIRE_CLOCK 100000
-#define WIRE_MAX 32
-#define REPEATED_WIRE_SEND_COUNT 1      // 1 for AVR, 8 for RP2040
-
-
-void wirewrap_setup() {
-  //pinMode(SDA, INPUT_PULLUP);
-  //pinMode(SCL, INPUT_PULLUP);
-
-  wire_start();
-  wire_read_all();
+WireWrapSlave::WireWrapSlave(I2CMaster *i2c, uint8_t address)
+    : _i2c(i2c), _address(address) {
 }
 
-void wire_start()
-{
-  Wire.begin(SDA, SCL);
-  Wire.setClock(WIRE_CLOCK);
-}
+void WireWrapSlave::begin() {
+    // Terminate whatever partial line is sitting in the slave, then read
+    // until it answers with an empty line (nothing pending)
+    _i2c->writeByte(_address, END_TOKEN);
+    delay(20);
+
+    for (uint8_t lines = 0; lines < 4; lines++) {
+        uint8_t len = 0;
+        uint8_t c = 0;
+        for (uint8_t i = 0; i < sizeof(_rx); i++) {
+            if (!_i2c->readByte(_address, c) || c == END_TOKEN) break;
+            len++;
+        }
+        if (len == 0) break;
+    }
 
-void wirewrap_loop() {
-  // poll sensors / peripherals if needed
+    _state = WW_IDLE;
+    _rxLen = 0;
+    _staleLines = 0;
+    _errors = 0;
 }
 
-void wire_read_all()
-{
-  for (byte address = 1; address < WIRE_MAX; address++ )
-  {
-    if (wire_exists(address))
-    {
-      Serial.print("Address: ");
-      Serial.println(address);
-      wire_readline(address);
-    }
-  }
-}
+bool WireWrapSlave::startJob(const Job &job) {
+    if (_state != WW_IDLE && _state != WW_ERROR) return false;
 
-void wire_send_all(String message)
-{
-  for (byte address = 1; address < WIRE_MAX; address++ )
-  {
-    if (wire_exists(address))
-    {
-      Serial.print("Address: ");
-      Serial.println(address);
-      wire_sendln(address, message);
-    }
-  }
-}
+    int n = snprintf(_tx, sizeof(_tx), "%.40s%c%.40s%c%u%c",
+        job.seedHex, SEP_TOKEN, job.targetHex, SEP_TOKEN, job.difficulty, END_TOKEN);
+    if (n <= 0 || n >= (int)sizeof(_tx)) return false;
 
-boolean wire_exists(byte address)
-{
-  wire_start();
-  Wire.beginTransmission(address);
-  byte error = Wire.endTransmission();
-  return (error == 0);
+    _txLen = n;
+    _txPos = 0;
+    _rxLen = 0;
+    _errors = 0;
+    _lastStepUs = micros() - _charPacingUs;
+    _state = WW_SENDING;
+    return true;
 }
 
-void wire_send_job(byte address, String lastblockhash, String newblockhash, int difficulty)
-{
-  String job = lastblockhash + "," + newblockhash + "," + difficulty;
-  wire_sendln(address, job);
-}
+WireWrapSlave::WW_STATE WireWrapSlave::poll() {
+    switch (_state) {
+    case WW_SENDING:
+        if (micros() - _lastStepUs < _charPacingUs) break;
+        _lastStepUs = micros();
+        if (!_i2c->writeByte(_address, (uint8_t)_tx[_txPos])) {
+            _error();
+            break;
+        }
+        if (++_txPos >= _txLen) {
+            _lastPollMs = millis();
+            _state = WW_WAITING;
+        }
+        break;
+
+    case WW_WAITING:
+        if (millis() - _lastPollMs < _resultPollMs) break;
+        _lastPollMs = millis();
+        _lastStepUs = micros();
+        _rxLen = 0;
+        _state = WW_READING;
+        // fall through, first byte now
+
+    case WW_READING: {
+        if (_rxLen > 0 && micros() - _lastStepUs < _readPacingUs) break;
+        _lastStepUs = micros();
+
+        uint8_t c;
+        if (!_i2c->readByte(_address, c)) {
+            _error();
+            break;
+        }
+        if (c == '\r') break;
+        if (c != END_TOKEN) {
+            if (_rxLen >= sizeof(_rx) - 1) {
+                _error();       // not a line we understand
+                break;
+            }
+            _rx[_rxLen++] = (char)c;
+            break;
+        }
+
+        // A bare newline means it's still hashing
+        if (_rxLen == 0) {
+            _state = WW_WAITING;
+            break;
+        }
+        _rx[_rxLen] = '\0';
+
+        if (_staleLines > 0) {
+            _staleLines--;
+            _rxLen = 0;
+            _state = WW_WAITING;
+            break;
+        }
+
+        _state = _parseResult() ? WW_DONE : WW_ERROR;
+        break;
+    }
 
-void wire_sendln(byte address, String message)
-{
-  wire_send(address, message + "\n");
+    default:
+        break;
+    }
+    return _state;
 }
 
-void wire_send_cmd(byte address, String message)
-{
-  wire_send(address, message + '$');
+bool WireWrapSlave::getResult(uint32_t &nonce, uint32_t &elapsedUs) {
+    if (_state != WW_DONE) return false;
+    nonce = _nonce;
+    elapsedUs = _elapsedUs;
+    _state = WW_IDLE;
+    return true;
 }
 
-void wire_send(byte address, String message)
-{
-  wire_start();
-  
-  int i=0;
-  while (i < message.length())
-  {
-    if (wire_run_every_micro(500)) {
-      Wire.beginTransmission(address);
-      for (int j=0; j < REPEATED_WIRE_SEND_COUNT; j++) {
-        Wire.write(message.charAt(i));
-      }
-      Wire.endTransmission();
-      i++;
+uint32_t WireWrapSlave::nextStepUs() const {
+    switch (_state) {
+    case WW_SENDING:
+        return _lastStepUs + _charPacingUs;
+    case WW_READING:
+        return _lastStepUs + _readPacingUs;
+    case WW_WAITING: {
+        const uint32_t waitedMs = millis() - _lastPollMs;
+        return micros() + (waitedMs < _resultPollMs ? (_resultPollMs - waitedMs) * 1000UL : 0);
+    }
+    default:
+        return micros();
     }
-  }
 }
 
-String wire_readline(int address)
-{
-  wire_run_every(0);
-  char end = '\n';
-  String str = "";
-  boolean done = false;
-  wire_start();
-  while (!done)
-  {
-    Wire.requestFrom(address, 1);
-    if (Wire.available())
-    {
-      char c = Wire.read();
-      //Serial.print(c);
-      if (c == end)
-      {
-        break;
-        done = true;
-      }
-      str += c;
+void WireWrapSlave::reset() {
+    // Once the whole line has gone out the slave is hashing and will answer
+    if (_state == WW_WAITING || _state == WW_READING) {
+        if (_staleLines < 255) _staleLines++;
     }
-    if (wire_run_every(2000)) break;
-  }
-  //str += end;
-  return str;
+    else if (_state == WW_SENDING && _txPos > 0) {
+        // Half a line in the slave's buffer, end it so it gets discarded
+        _i2c->writeByte(_address, END_TOKEN);
+        if (_staleLines < 255) _staleLines++;
+    }
+    _rxLen = 0;
+    _state = WW_IDLE;
 }
 
-boolean wire_run_every(unsigned long interval)
-{
-  static unsigned long previousMillis = 0;
-  unsigned long currentMillis = millis();
-  if (currentMillis - previousMillis >= interval)
-  {
-    previousMillis = currentMillis;
-    return true;
-  }
-  return false;
-}
+// -----------------------------------------------
+//               ------ PRIVATE -------
+// -----------------------------------------------
 
-boolean wire_run_every_micro(unsigned long interval)
-{
-  static unsigned long previousMicros = 0;
-  unsigned long currentMicros = micros();
-  if (currentMicros - previousMicros >= interval)
-  {
-    previousMicros = currentMicros;
+// "nonce,elapsed_us,DUCOID..."
+bool WireWrapSlave::_parseResult() {
+    char *end = nullptr;
+    _nonce = strtoul(_rx, &end, 10);
+    if (end == _rx || *end != SEP_TOKEN) return false;
+
+    char *start = end + 1;
+    _elapsedUs = strtoul(start, &end, 10);
+    if (end == start) return false;
+
+    DEBUGPRINT("[WIRE] 0x");
+    DEBUGPRINT_HEX(_address);
+    DEBUGPRINT(" result: ");
+    DEBUGPRINT_LN(_rx);
     return true;
-  }
-  return false;
 }
 
-void wire_scan() {
-  Serial.println("Scanning...");
-  uint8_t address = 1;
-  for (address = 1; address < 127; address++) {
-    Wire.beginTransmission(address);
-    uint8_t error = Wire.endTransmission();
-
-    // If endTransmission() returns 0, the device acknowledged the address
-    if (error == 0) {
-      Serial.print("I2C device found at address 0x");
-      if (address < 16) {
-        Serial.print("0"); // Pad with a leading zero for single-digit hex
-      }
-      Serial.print(address, HEX);
-      Serial.println(" !");
-    } else if (error == 4) {
-      // Error 4 means "unknown error" but can sometimes indicate a disconnected device
-      Serial.print("Unknown error at address 0x");
-      Serial.print(address, HEX);
-      Serial.println();
+void WireWrapSlave::_error() {
+    if (++_errors >= _maxErrors) {
+        DEBUGPRINT("[WIRE] 0x");
+        DEBUGPRINT_HEX(_address);
+        DEBUGPRINT_LN(" too many bus errors");
+        _state = WW_ERROR;
     }
-  }
-}
\ No newline at end of file
+}